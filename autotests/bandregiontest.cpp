@@ -0,0 +1,244 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "bandregion.h"
+
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <array>
+#include <cmath>
+
+using namespace Lightly;
+
+class BandRegionTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void subtracted_data();
+    void subtracted();
+    void intersected_data();
+    void intersected();
+    void transform_data();
+    void transform();
+    void trimCornersQRegion_data();
+    void trimCornersQRegion();
+    void trimCornersBandRegion_data();
+    void trimCornersBandRegion();
+};
+
+// The opaque region of a window the way prePaintWindow gets it, with or without a few holes cut by
+// translucent parts, and the four corner squares that get trimmed off it
+static QRegion windowOpaque(QRect const& frame, bool holes)
+{
+    QRegion opaque(frame);
+    if (holes) {
+        opaque -= QRect(frame.x() + 40, frame.y() + 30, 200, 24);
+        opaque -= QRect(frame.x() + 300, frame.y() + 120, 60, 300);
+        opaque -= QRect(frame.x(), frame.bottom() - 40, frame.width() / 2, 40);
+    }
+    return opaque;
+}
+
+static std::array<QRect, 4> windowCorners(QRect const& frame, int size)
+{
+    return {
+        QRect(frame.x(), frame.y(), size, size),
+        QRect(frame.right() - size + 1, frame.y(), size, size),
+        QRect(frame.right() - size + 1, frame.bottom() - size + 1, size, size),
+        QRect(frame.x(), frame.bottom() - size + 1, size, size),
+    };
+}
+
+static void addWindows()
+{
+    QTest::addColumn<QRect>("frame");
+    QTest::addColumn<bool>("holes");
+    QTest::addColumn<int>("cornerSize");
+
+    QTest::newRow("plain") << QRect(100, 80, 1280, 800) << false << 12;
+    QTest::newRow("holes") << QRect(100, 80, 1280, 800) << true << 12;
+    QTest::newRow("large corners") << QRect(0, 0, 3840, 2160) << true << 48;
+}
+
+void BandRegionTest::subtracted_data()
+{
+    addWindows();
+}
+
+void BandRegionTest::subtracted()
+{
+    QFETCH(QRect, frame);
+    QFETCH(bool, holes);
+    QFETCH(int, cornerSize);
+
+    QRegion expected = windowOpaque(frame, holes);
+    BandRegion opaque(expected);
+    BandRegion corner;
+    BandRegion trimmed;
+    for (QRect const& rect : windowCorners(frame, cornerSize)) {
+        expected -= rect;
+        corner.assign(rect);
+        BandRegion::subtracted(opaque, corner, trimmed);
+        opaque.assign(trimmed);
+    }
+
+    QCOMPARE(opaque.toRegion(), expected);
+    QCOMPARE(opaque.boundingRect(), expected.boundingRect());
+}
+
+// A region of overlapping rects, so that it has many bands with several spans each
+static QRegion randomRegion(QRandomGenerator& random, int count)
+{
+    QRegion region;
+    for (int i = 0; i < count; ++i) {
+        region += QRect(random.bounded(-200, 1000), random.bounded(-200, 800), random.bounded(1, 400), random.bounded(1, 300));
+    }
+    return region;
+}
+
+void BandRegionTest::intersected_data()
+{
+    QTest::addColumn<quint32>("seed");
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("sparse") << 1u << 4;
+    QTest::newRow("dense") << 2u << 40;
+    QTest::newRow("uneven") << 3u << 60;
+}
+
+void BandRegionTest::intersected()
+{
+    QFETCH(quint32, seed);
+    QFETCH(int, count);
+
+    QRandomGenerator random(seed);
+    BandRegion result;
+    for (int i = 0; i < 20; ++i) {
+        QRegion const a = randomRegion(random, count);
+        QRegion const b = randomRegion(random, count / 2 + 1);
+
+        BandRegion::intersected(BandRegion(a), BandRegion(b), result);
+        QCOMPARE(result.toRegion(), a & b);
+        QCOMPARE(result.boundingRect(), (a & b).boundingRect());
+
+        BandRegion::subtracted(BandRegion(a), BandRegion(b), result);
+        QCOMPARE(result.toRegion(), a - b);
+    }
+}
+
+void BandRegionTest::transform_data()
+{
+    QTest::addColumn<qreal>("xScale");
+    QTest::addColumn<qreal>("yScale");
+    QTest::addColumn<QPointF>("origin");
+    QTest::addColumn<QPointF>("translation");
+
+    QTest::newRow("identity") << 1.0 << 1.0 << QPointF(0, 0) << QPointF(0, 0);
+    QTest::newRow("translated") << 1.0 << 1.0 << QPointF(0, 0) << QPointF(37, -12);
+    QTest::newRow("fractional translation") << 1.0 << 1.0 << QPointF(0, 0) << QPointF(0.5, -0.25);
+    QTest::newRow("half") << 0.5 << 0.5 << QPointF(0, 0) << QPointF(0, 0);
+    QTest::newRow("minimized") << 0.75 << 0.75 << QPointF(100.5, 80.25) << QPointF(12.3, 4.7);
+    QTest::newRow("grown") << 1.3 << 1.3 << QPointF(400, 300) << QPointF(-0.6, 0.6);
+    QTest::newRow("squeezed") << 0.2 << 1.1 << QPointF(-50, 20) << QPointF(3.5, 0);
+    QTest::newRow("tiny") << 0.01 << 0.01 << QPointF(0, 0) << QPointF(0, 0);
+}
+
+void BandRegionTest::transform()
+{
+    QFETCH(qreal, xScale);
+    QFETCH(qreal, yScale);
+    QFETCH(QPointF, origin);
+    QFETCH(QPointF, translation);
+
+    auto mapX = [&](int x) {
+        return int(std::floor(origin.x() + (x - origin.x()) * xScale + translation.x()));
+    };
+    auto mapY = [&](int y) {
+        return int(std::floor(origin.y() + (y - origin.y()) * yScale + translation.y()));
+    };
+
+    QRandomGenerator random(4);
+    for (int i = 0; i < 20; ++i) {
+        QRegion const input = randomRegion(random, 30);
+
+        // Every rect mapped on its own, QRegion merges whatever touches or collapses afterwards
+        QRegion expected;
+        for (QRect const& rect : input) {
+            int const left = mapX(rect.x());
+            int const top = mapY(rect.y());
+            int const right = mapX(rect.x() + rect.width());
+            int const bottom = mapY(rect.y() + rect.height());
+            if (left < right && top < bottom) {
+                expected += QRect(left, top, right - left, bottom - top);
+            }
+        }
+
+        BandRegion region(input);
+        region.transform(origin, xScale, yScale, translation);
+        QCOMPARE(region.toRegion(), expected);
+        QCOMPARE(region.boundingRect(), expected.boundingRect());
+
+        region.translate(QPoint(-7, 9));
+        QCOMPARE(region.toRegion(), expected.translated(-7, 9));
+    }
+}
+
+void BandRegionTest::trimCornersQRegion_data()
+{
+    addWindows();
+}
+
+void BandRegionTest::trimCornersQRegion()
+{
+    QFETCH(QRect, frame);
+    QFETCH(bool, holes);
+    QFETCH(int, cornerSize);
+
+    QRegion const input = windowOpaque(frame, holes);
+    auto const corners = windowCorners(frame, cornerSize);
+    QRegion opaque;
+    QBENCHMARK {
+        opaque = input;
+        for (QRect const& rect : corners) {
+            opaque -= rect;
+        }
+    }
+    QVERIFY(!opaque.isEmpty());
+}
+
+void BandRegionTest::trimCornersBandRegion_data()
+{
+    addWindows();
+}
+
+void BandRegionTest::trimCornersBandRegion()
+{
+    QFETCH(QRect, frame);
+    QFETCH(bool, holes);
+    QFETCH(int, cornerSize);
+
+    QRegion const input = windowOpaque(frame, holes);
+    auto const corners = windowCorners(frame, cornerSize);
+    BandRegion buffers[2];
+    BandRegion corner;
+    BandRegion* opaque = &buffers[0];
+    QBENCHMARK {
+        opaque = &buffers[0];
+        BandRegion* trimmed = &buffers[1];
+        opaque->assign(input);
+        for (QRect const& rect : corners) {
+            corner.assign(rect);
+            BandRegion::subtracted(*opaque, corner, *trimmed);
+            std::swap(opaque, trimmed);
+        }
+    }
+    QVERIFY(!opaque->isEmpty());
+}
+
+QTEST_GUILESS_MAIN(BandRegionTest)
+
+#include "bandregiontest.moc"
@@ -0,0 +1,229 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "offscreengl.h"
+
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <algorithm>
+#include <vector>
+
+using namespace Lightly;
+
+// Renders the Dual Kawase pyramid with the fragment shaders and with the compute shader, the way
+// renderPyramid() and renderPyramidCompute() do, and compares the level read by the final pass
+class ComputeBlurTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void sameAsFragment_data();
+    void sameAsFragment();
+    void benchmarkPyramid_data();
+    void benchmarkPyramid();
+
+private:
+    enum class Path {
+        Fragment,
+        Compute,
+    };
+
+    GLuint renderPyramid(Path path, GLuint source, QSize const& size, int iterations, float offset);
+    void releaseTextures();
+
+    OffscreenGL m_gl;
+    GLuint m_downsample = 0;
+    GLuint m_upsample = 0;
+    GLuint m_computeDownsample = 0;
+    GLuint m_computeUpsample = 0;
+    std::vector<GLuint> m_textures;
+};
+
+// The same work group sizes as ComputeBlur, the pyramid is rendered in GL_RGBA8
+static QByteArray computeShader(bool upsample)
+{
+    QByteArray source = QByteArrayLiteral("#version 430\n#define OUTPUT_FORMAT rgba8\n");
+    source += upsample ? QByteArrayLiteral("#define LOCAL_SIZE 16\n#define UPSAMPLE\n") : QByteArrayLiteral("#define LOCAL_SIZE 8\n");
+    return source + OffscreenGL::shaderSource(QStringLiteral("blur/shaders/blur.comp"));
+}
+
+static QImage noise(QSize const& size)
+{
+    QImage image(size, QImage::Format_RGBA8888);
+    QRandomGenerator random(42);
+    for (int y = 0; y < size.height(); ++y) {
+        uchar* row = image.scanLine(y);
+        for (int x = 0; x < size.width(); ++x) {
+            // Noise on top of gradients, with some hard edges
+            row[x * 4 + 0] = std::clamp(x * 255 / size.width() + int(random.bounded(64)) - 32, 0, 255);
+            row[x * 4 + 1] = std::clamp(y * 255 / size.height() + int(random.bounded(64)) - 32, 0, 255);
+            row[x * 4 + 2] = ((x / 16 + y / 16) % 2) ? 230 : 20;
+            row[x * 4 + 3] = 255;
+        }
+    }
+    return image;
+}
+
+static QSize levelSize(QSize const& size, int level)
+{
+    return QSize(std::max(1, size.width() >> level), std::max(1, size.height() >> level));
+}
+
+void ComputeBlurTest::initTestCase()
+{
+    if (!m_gl.create(4, 3)) {
+        QSKIP("No OpenGL 4.3 context");
+    }
+    qInfo() << "Renderer:" << m_gl.renderer();
+
+    QByteArray const vertex = OffscreenGL::shaderSource(QStringLiteral("blur/shaders/vertex_core.vert"));
+    m_downsample = m_gl.program(vertex, OffscreenGL::shaderSource(QStringLiteral("blur/shaders/downsample_core.frag")));
+    m_upsample = m_gl.program(vertex, OffscreenGL::shaderSource(QStringLiteral("blur/shaders/upsample_core.frag")));
+    m_computeDownsample = m_gl.computeProgram(computeShader(false));
+    m_computeUpsample = m_gl.computeProgram(computeShader(true));
+    QVERIFY(m_downsample && m_upsample && m_computeDownsample && m_computeUpsample);
+
+    // The vertices are given in clip space already
+    GLfloat const identity[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    for (GLuint program : { m_downsample, m_upsample }) {
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, identity);
+        glUniform2f(glGetUniformLocation(program, "textureScale"), 1, 1);
+        glUniform2f(glGetUniformLocation(program, "textureOffset"), 0, 0);
+    }
+    glUseProgram(0);
+}
+
+void ComputeBlurTest::cleanupTestCase()
+{
+    releaseTextures();
+    for (GLuint program : { m_downsample, m_upsample, m_computeDownsample, m_computeUpsample }) {
+        glDeleteProgram(program);
+    }
+}
+
+void ComputeBlurTest::releaseTextures()
+{
+    glDeleteTextures(GLsizei(m_textures.size()), m_textures.data());
+    m_textures.clear();
+}
+
+GLuint ComputeBlurTest::renderPyramid(Path path, GLuint source, QSize const& size, int iterations, float offset)
+{
+    // Down to the deepest level, then up again into textures of their own, as far as the level the
+    // final pass reads
+    auto pass = [&](bool upsample, GLuint read, QSize const& readSize, QSize const& drawSize) {
+        GLuint const draw = m_gl.texture(drawSize, GL_RGBA8);
+        m_textures.push_back(draw);
+        glBindTexture(GL_TEXTURE_2D, read);
+
+        if (path == Path::Compute) {
+            GLuint const program = upsample ? m_computeUpsample : m_computeDownsample;
+            int const localSize = upsample ? 16 : 8;
+            glUseProgram(program);
+            glUniform2i(glGetUniformLocation(program, "sourceSize"), readSize.width(), readSize.height());
+            glUniform2i(glGetUniformLocation(program, "destinationSize"), drawSize.width(), drawSize.height());
+            glUniform2i(glGetUniformLocation(program, "destinationOrigin"), 0, 0);
+            glUniform1f(glGetUniformLocation(program, "offset"), offset);
+            glBindImageTexture(0, draw, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glDispatchCompute((drawSize.width() + localSize - 1) / localSize, (drawSize.height() + localSize - 1) / localSize, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+            glUseProgram(0);
+        } else {
+            GLuint const program = upsample ? m_upsample : m_downsample;
+            float const width = readSize.width();
+            float const height = readSize.height();
+            glUseProgram(program);
+            glUniform1f(glGetUniformLocation(program, "offset"), offset);
+            glUniform2f(glGetUniformLocation(program, "halfpixel"), 0.5f / width, 0.5f / height);
+            glUniform4f(glGetUniformLocation(program, "textureBounds"), 0.5f / width, 0.5f / height, (width - 0.5f) / width, (height - 0.5f) / height);
+            m_gl.draw(program, draw, drawSize);
+        }
+        return draw;
+    };
+
+    std::vector<GLuint> levels = { source };
+    for (int i = 1; i <= iterations; ++i) {
+        levels.push_back(pass(false, levels[i - 1], levelSize(size, i - 1), levelSize(size, i)));
+    }
+    GLuint result = levels[iterations];
+    for (int i = iterations - 1; i >= 1; --i) {
+        result = pass(true, result, levelSize(size, i + 1), levelSize(size, i));
+    }
+    return result;
+}
+
+void ComputeBlurTest::sameAsFragment_data()
+{
+    QTest::addColumn<int>("iterations");
+    QTest::addColumn<float>("offset");
+
+    // Offsets within the range the strength table uses for every iteration count
+    QTest::newRow("1 iteration") << 1 << 1.5f;
+    QTest::newRow("2 iterations") << 2 << 2.5f;
+    QTest::newRow("3 iterations") << 3 << 4.0f;
+    QTest::newRow("4 iterations") << 4 << 6.0f;
+    QTest::newRow("5 iterations") << 5 << 7.0f;
+    QTest::newRow("6 iterations") << 6 << 10.0f;
+}
+
+void ComputeBlurTest::sameAsFragment()
+{
+    QFETCH(int, iterations);
+    QFETCH(float, offset);
+
+    // Not a multiple of the work group sizes, so that the partial groups at the edges are covered
+    QSize const size(300, 200);
+    GLuint const source = m_gl.texture(size, GL_RGBA8, noise(size));
+    m_textures.push_back(source);
+
+    QSize const resultSize = levelSize(size, 1);
+    QImage const fragment = m_gl.read(renderPyramid(Path::Fragment, source, size, iterations, offset), resultSize);
+    QImage const compute = m_gl.read(renderPyramid(Path::Compute, source, size, iterations, offset), resultSize);
+    releaseTextures();
+
+    // The texture units filter with a few bits of the fraction, the compute shader filters in floats.
+    // Every pass rounds to 8 bits, so the paths may drift apart by a few steps.
+    int const difference = maxDifference(fragment, compute);
+    qInfo() << "Largest difference:" << difference;
+    QVERIFY2(difference <= 3, qPrintable(QStringLiteral("The compute path differs by %1").arg(difference)));
+}
+
+void ComputeBlurTest::benchmarkPyramid_data()
+{
+    QTest::addColumn<bool>("compute");
+    QTest::addColumn<QSize>("size");
+
+    QSize const sizes[] = { QSize(1280, 720), QSize(1920, 1080), QSize(2560, 1440), QSize(3840, 2160) };
+    for (QSize const& size : sizes) {
+        QTest::addRow("fragment %dx%d", size.width(), size.height()) << false << size;
+        QTest::addRow("compute %dx%d", size.width(), size.height()) << true << size;
+    }
+}
+
+void ComputeBlurTest::benchmarkPyramid()
+{
+    QFETCH(bool, compute);
+    QFETCH(QSize, size);
+
+    // A backdrop of the whole screen blurred with four iterations
+    GLuint const source = m_gl.texture(size, GL_RGBA8, noise(size));
+    m_textures.push_back(source);
+
+    QBENCHMARK {
+        renderPyramid(compute ? Path::Compute : Path::Fragment, source, size, 4, 4.0f);
+        glFinish();
+        glDeleteTextures(GLsizei(m_textures.size() - 1), m_textures.data() + 1);
+        m_textures.resize(1);
+    }
+    releaseTextures();
+}
+
+QTEST_MAIN(ComputeBlurTest)
+
+#include "computeblurtest.moc"
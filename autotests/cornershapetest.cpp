@@ -0,0 +1,157 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "lshelper.h"
+#include "offscreengl.h"
+
+#include <KConfigGroup>
+#include <KSharedConfig>
+
+#include <QStandardPaths>
+#include <QTest>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Lightly;
+
+// Draws the corners the way the window shader and the final blur pass do and compares the coverage
+class CornerShapeTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cornersLineUp_data();
+    void cornersLineUp();
+
+private:
+    OffscreenGL m_gl;
+};
+
+// The window shader without the color management of KWin
+static QByteArray windowShader()
+{
+    QByteArray source = OffscreenGL::shaderSource(QStringLiteral("lightlyshaders/shaders/lightlyshaders_core.frag"));
+    source.replace("#include \"colormanagement.glsl\"",
+                   "vec4 sourceEncodingToNitsInDestinationColorspace(vec4 color) { return color; }\n"
+                   "vec4 nitsToDestinationEncoding(vec4 color) { return color; }\n");
+    return source;
+}
+
+static QByteArray const s_windowVertexShader = QByteArrayLiteral(
+    "#version 140\n"
+    "in vec2 position;\n"
+    "in vec2 texcoord;\n"
+    "out vec2 texcoord0;\n"
+    "void main(void)\n"
+    "{\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "    texcoord0 = texcoord;\n"
+    "}\n");
+
+void CornerShapeTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    if (!m_gl.create(3, 3)) {
+        QSKIP("No OpenGL 3.3 context");
+    }
+    qInfo() << "Renderer:" << m_gl.renderer();
+}
+
+void CornerShapeTest::cornersLineUp_data()
+{
+    QTest::addColumn<QString>("cornersType");
+    QTest::addColumn<int>("roundness");
+    QTest::addColumn<int>("squircleRatio");
+    QTest::addColumn<qreal>("scale");
+
+    QTest::newRow("rounded") << QStringLiteral("RoundedCorners") << 8 << 5 << 1.0;
+    QTest::newRow("rounded scaled") << QStringLiteral("RoundedCorners") << 8 << 5 << 1.5;
+    QTest::newRow("squircled") << QStringLiteral("SquircledCorners") << 6 << 5 << 1.0;
+    QTest::newRow("squircled scaled") << QStringLiteral("SquircledCorners") << 6 << 5 << 1.25;
+    QTest::newRow("squircled steep") << QStringLiteral("SquircledCorners") << 4 << 12 << 1.0;
+}
+
+void CornerShapeTest::cornersLineUp()
+{
+    QFETCH(QString, cornersType);
+    QFETCH(int, roundness);
+    QFETCH(int, squircleRatio);
+    QFETCH(qreal, scale);
+
+    // Both effects take the radius and the exponent from the helper, which reads them from the config
+    KConfigGroup group = KSharedConfig::openConfig(QStringLiteral("lightlyshaders.conf"))->group(QStringLiteral("General"));
+    group.writeEntry("CornersType", cornersType);
+    group.writeEntry("Roundness", roundness);
+    group.writeEntry("SquircleRatio", squircleRatio);
+    group.sync();
+
+    LSHelper helper;
+    helper.reconfigure();
+    float const radius = helper.roundness() * scale;
+    int const exponent = helper.cornerExponent();
+    QCOMPARE(exponent > 0, cornersType == QLatin1String("SquircledCorners"));
+
+    QSize const frame(std::round(120 * scale), std::round(90 * scale));
+    QImage white(1, 1, QImage::Format_RGBA8888);
+    white.fill(Qt::white);
+    GLuint const content = m_gl.texture(QSize(1, 1), GL_RGBA8, white);
+
+    // The window shader, as drawWindow() of the window effect sets it up for a window without shadow
+    GLuint const window = m_gl.program(s_windowVertexShader, windowShader());
+    QVERIFY(window);
+    glUseProgram(window);
+    glUniform2f(glGetUniformLocation(window, "expanded_size"), frame.width(), frame.height());
+    glUniform2f(glGetUniformLocation(window, "frame_size"), frame.width(), frame.height());
+    glUniform3f(glGetUniformLocation(window, "shadow_size"), 0, 0, 0);
+    glUniform1f(glGetUniformLocation(window, "radius"), radius);
+    glUniform1i(glGetUniformLocation(window, "squircle_ratio"), exponent);
+    glUniform1i(glGetUniformLocation(window, "is_squircle"), exponent > 0);
+    glUniform1i(glGetUniformLocation(window, "draw_inner_outline"), GL_FALSE);
+    glUniform1i(glGetUniformLocation(window, "draw_outer_outline"), GL_FALSE);
+    glUniform4f(glGetUniformLocation(window, "modulation"), 1, 1, 1, 1);
+    glUniform1f(glGetUniformLocation(window, "saturation"), 1);
+    glBindTexture(GL_TEXTURE_2D, content);
+    GLuint const windowTarget = m_gl.texture(frame, GL_RGBA8);
+    m_gl.draw(window, windowTarget, frame);
+
+    // The final blur pass, as blur() sets it up with the corner shape of the helper
+    GLuint const blur = m_gl.program(OffscreenGL::shaderSource(QStringLiteral("blur/shaders/vertex_core.vert")),
+                                     OffscreenGL::shaderSource(QStringLiteral("blur/shaders/final_core.frag")));
+    QVERIFY(blur);
+    GLfloat const identity[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    glUseProgram(blur);
+    glUniformMatrix4fv(glGetUniformLocation(blur, "modelViewProjectionMatrix"), 1, GL_FALSE, identity);
+    glUniform2f(glGetUniformLocation(blur, "textureScale"), 1, 1);
+    glUniform2f(glGetUniformLocation(blur, "textureOffset"), 0, 0);
+    glUniform1f(glGetUniformLocation(blur, "offset"), 1);
+    glUniform2f(glGetUniformLocation(blur, "halfpixel"), 0.5, 0.5);
+    glUniform4f(glGetUniformLocation(blur, "textureBounds"), 0, 0, 1, 1);
+    glUniform1f(glGetUniformLocation(blur, "noiseStrength"), 0);
+    glUniform1f(glGetUniformLocation(blur, "noiseScale"), 1);
+    glUniform1f(glGetUniformLocation(blur, "opacity"), 1);
+    glUniform4f(glGetUniformLocation(blur, "cornerRect"), 0, 0, frame.width(), frame.height());
+    glUniform1f(glGetUniformLocation(blur, "cornerRadius"), std::min({ radius, frame.width() / 2.0f, frame.height() / 2.0f }));
+    glUniform1f(glGetUniformLocation(blur, "cornerExponent"), exponent);
+    glUniform1f(glGetUniformLocation(blur, "maskEnabled"), 0);
+    GLuint const blurTarget = m_gl.texture(frame, GL_RGBA8);
+    m_gl.draw(blur, blurTarget, frame);
+
+    QImage const windowImage = m_gl.read(windowTarget, frame);
+    QImage const blurImage = m_gl.read(blurTarget, frame);
+    QVERIFY(qAlpha(windowImage.pixel(0, 0)) < 255);
+    QVERIFY(qAlpha(windowImage.pixel(frame.width() / 2, frame.height() / 2)) == 255);
+    QVERIFY2(maxDifference(windowImage, blurImage) <= 1, qPrintable(QStringLiteral("The corners differ by %1").arg(maxDifference(windowImage, blurImage))));
+
+    glDeleteProgram(window);
+    glDeleteProgram(blur);
+    GLuint const textures[] = { content, windowTarget, blurTarget };
+    glDeleteTextures(3, textures);
+}
+
+QTEST_MAIN(CornerShapeTest)
+
+#include "cornershapetest.moc"
@@ -0,0 +1,223 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "offscreengl.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace Lightly;
+
+// Renders a gradient through the Dual Kawase pyramid with the intermediate levels in the formats
+// BlurEffect::intermediateFormat() picks, and compares the level the final pass reads with the same
+// pyramid in GL_RGBA16F. As in BlurEffect, that level keeps the output's format.
+class IntermediateFormatTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void gradient_data();
+    void gradient();
+
+private:
+    GLuint renderPyramid(GLuint source, QSize const& size, int iterations, float offset, GLenum intermediateFormat);
+    bool renderable(GLenum format);
+    void releaseTextures();
+
+    OffscreenGL m_gl;
+    GLuint m_downsample = 0;
+    GLuint m_upsample = 0;
+    std::vector<GLuint> m_textures;
+};
+
+static GLenum const s_outputFormat = GL_RGBA16F;
+
+static QSize levelSize(QSize const& size, int level)
+{
+    return QSize(std::max(1, size.width() >> level), std::max(1, size.height() >> level));
+}
+
+// Smooth ramps over the whole range of the normalized formats, a dark one for the blue channel
+// where the float formats are the most precise
+static QImage gradient(QSize const& size)
+{
+    QImage image(size, QImage::Format_RGBA32FPx4);
+    for (int y = 0; y < size.height(); ++y) {
+        float* row = reinterpret_cast<float*>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            float const u = float(x) / (size.width() - 1);
+            float const v = float(y) / (size.height() - 1);
+            row[x * 4 + 0] = u;
+            row[x * 4 + 1] = v;
+            row[x * 4 + 2] = 0.1f * (u + v);
+            row[x * 4 + 3] = 1.0f;
+        }
+    }
+    return image;
+}
+
+static float maxColorDifference(QImage const& a, QImage const& b)
+{
+    float difference = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        float const* rowA = reinterpret_cast<float const*>(a.constScanLine(y));
+        float const* rowB = reinterpret_cast<float const*>(b.constScanLine(y));
+        for (int x = 0; x < a.width(); ++x) {
+            // The final pass doesn't read the alpha of the blurred backdrop
+            for (int channel = 0; channel < 3; ++channel) {
+                difference = std::max(difference, std::abs(rowA[x * 4 + channel] - rowB[x * 4 + channel]));
+            }
+        }
+    }
+    return difference;
+}
+
+void IntermediateFormatTest::initTestCase()
+{
+    if (!m_gl.create(3, 3)) {
+        QSKIP("No OpenGL 3.3 context");
+    }
+    qInfo() << "Renderer:" << m_gl.renderer();
+
+    QByteArray const vertex = OffscreenGL::shaderSource(QStringLiteral("blur/shaders/vertex_core.vert"));
+    m_downsample = m_gl.program(vertex, OffscreenGL::shaderSource(QStringLiteral("blur/shaders/downsample_core.frag")));
+    m_upsample = m_gl.program(vertex, OffscreenGL::shaderSource(QStringLiteral("blur/shaders/upsample_core.frag")));
+    QVERIFY(m_downsample && m_upsample);
+
+    // The vertices are given in clip space already
+    GLfloat const identity[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    for (GLuint program : { m_downsample, m_upsample }) {
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, identity);
+        glUniform2f(glGetUniformLocation(program, "textureScale"), 1, 1);
+        glUniform2f(glGetUniformLocation(program, "textureOffset"), 0, 0);
+    }
+    glUseProgram(0);
+}
+
+void IntermediateFormatTest::cleanupTestCase()
+{
+    releaseTextures();
+    glDeleteProgram(m_downsample);
+    glDeleteProgram(m_upsample);
+}
+
+void IntermediateFormatTest::releaseTextures()
+{
+    glDeleteTextures(GLsizei(m_textures.size()), m_textures.data());
+    m_textures.clear();
+}
+
+bool IntermediateFormatTest::renderable(GLenum format)
+{
+    GLuint const texture = m_gl.texture(QSize(4, 4), format);
+    GLuint framebuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    bool const complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &texture);
+    return complete;
+}
+
+GLuint IntermediateFormatTest::renderPyramid(GLuint source, QSize const& size, int iterations, float offset, GLenum intermediateFormat)
+{
+    auto pass = [&](GLuint program, GLuint read, QSize const& readSize, QSize const& drawSize, GLenum format) {
+        GLuint const draw = m_gl.texture(drawSize, format);
+        m_textures.push_back(draw);
+        glBindTexture(GL_TEXTURE_2D, read);
+
+        float const width = readSize.width();
+        float const height = readSize.height();
+        glUseProgram(program);
+        glUniform1f(glGetUniformLocation(program, "offset"), offset);
+        glUniform2f(glGetUniformLocation(program, "halfpixel"), 0.5f / width, 0.5f / height);
+        glUniform4f(glGetUniformLocation(program, "textureBounds"), 0.5f / width, 0.5f / height, (width - 0.5f) / width, (height - 0.5f) / height);
+        m_gl.draw(program, draw, drawSize);
+        return draw;
+    };
+
+    // The level the final pass reads is the first downsample target with one iteration and the
+    // first upsample target otherwise
+    std::vector<GLuint> levels = { source };
+    for (int i = 1; i <= iterations; ++i) {
+        GLenum const format = iterations == 1 ? s_outputFormat : intermediateFormat;
+        levels.push_back(pass(m_downsample, levels[i - 1], levelSize(size, i - 1), levelSize(size, i), format));
+    }
+    GLuint result = levels[iterations];
+    for (int i = iterations - 1; i >= 1; --i) {
+        GLenum const format = i == 1 ? s_outputFormat : intermediateFormat;
+        result = pass(m_upsample, result, levelSize(size, i + 1), levelSize(size, i), format);
+    }
+    return result;
+}
+
+void IntermediateFormatTest::gradient_data()
+{
+    QTest::addColumn<uint>("format");
+    QTest::addColumn<float>("step");
+    QTest::addColumn<int>("iterations");
+    QTest::addColumn<float>("offset");
+
+    // The largest step between two values of the format in [0, 1]. For the packed floats it's the one
+    // of the blue channel in [0.5, 1), which has the shortest mantissa.
+    struct Format {
+        char const* name;
+        GLenum format;
+        float step;
+    };
+    Format const formats[] = {
+        { "RGBA8", GL_RGBA8, 1.0f / 255 },
+        { "RGB10_A2", GL_RGB10_A2, 1.0f / 1023 },
+        { "R11F_G11F_B10F", GL_R11F_G11F_B10F, 1.0f / 64 },
+    };
+    for (Format const& format : formats) {
+        QTest::addRow("%s 2 iterations", format.name) << uint(format.format) << format.step << 2 << 2.5f;
+        QTest::addRow("%s 4 iterations", format.name) << uint(format.format) << format.step << 4 << 6.0f;
+        QTest::addRow("%s 6 iterations", format.name) << uint(format.format) << format.step << 6 << 10.0f;
+    }
+}
+
+void IntermediateFormatTest::gradient()
+{
+    QFETCH(uint, format);
+    QFETCH(float, step);
+    QFETCH(int, iterations);
+    QFETCH(float, offset);
+
+    if (!renderable(format) || !renderable(s_outputFormat)) {
+        QSKIP("The format can't be rendered to");
+    }
+
+    QSize const size(640, 400);
+    GLuint const source = m_gl.texture(size, s_outputFormat, gradient(size));
+    m_textures.push_back(source);
+
+    QSize const resultSize = levelSize(size, 1);
+    QImage const reference = m_gl.readFloat(renderPyramid(source, size, iterations, offset, s_outputFormat), resultSize);
+    QImage const reduced = m_gl.readFloat(renderPyramid(source, size, iterations, offset, GLenum(format)), resultSize);
+    releaseTextures();
+
+    // Every pass takes an average with positive weights, so an error written into a level doesn't grow
+    // in the passes after it. The intermediate levels are written 2 * iterations - 2 times, each write
+    // is off by at most a step, rounding or truncating. The reference is off by the step of half floats
+    // in every one of its writes.
+    int const writes = 2 * iterations - 2;
+    float const bound = writes * step + (writes + 1) / 2048.0f;
+    float const difference = maxColorDifference(reference, reduced);
+    qInfo() << "Largest difference:" << difference << "bound:" << bound;
+    QVERIFY2(difference <= bound, qPrintable(QStringLiteral("The intermediate levels are off by %1").arg(difference)));
+}
+
+QTEST_MAIN(IntermediateFormatTest)
+
+#include "intermediateformattest.moc"
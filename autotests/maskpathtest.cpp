@@ -0,0 +1,262 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "offscreengl.h"
+
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <algorithm>
+#include <vector>
+
+using namespace Lightly;
+
+// Draws a blur shape of many rects with the final pass the way BlurEffect does, once as a quad per rect
+// and once as a single quad that tests a mask of the shape, to find where the mask gets cheaper
+class MaskPathTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void samePixels_data();
+    void samePixels();
+    void benchmarkFinalPass_data();
+    void benchmarkFinalPass();
+
+private:
+    void prepare(QList<QRect> const& shape, bool masked);
+    void draw();
+
+    OffscreenGL m_gl;
+    GLuint m_program = 0;
+    GLuint m_blurred = 0;
+    GLuint m_target = 0;
+    GLuint m_mask = 0;
+    GLuint m_framebuffer = 0;
+    GLuint m_vertexArray = 0;
+    GLuint m_vertexBuffer = 0;
+    int m_vertexCount = 0;
+    bool m_masked = false;
+};
+
+static QSize const s_targetSize(1920, 1080);
+static QRect const s_backgroundRect(160, 90, 1600, 900);
+
+// A window with translucent strips of different lengths, every strip is a band of its own. The
+// coordinates start at the bottom of the target as in OpenGL.
+static QList<QRect> stripes(int count)
+{
+    QList<QRect> shape;
+    for (int i = 0; i < count; ++i) {
+        int const top = s_backgroundRect.y() + s_backgroundRect.height() * i / count;
+        int const bottom = s_backgroundRect.y() + s_backgroundRect.height() * (i + 1) / count;
+        int const left = (i * 37) % 200;
+        int const right = (i * 53) % 200;
+        shape.append(QRect(s_backgroundRect.x() + left, top, s_backgroundRect.width() - left - right, bottom - top));
+    }
+    return shape;
+}
+
+static QImage noise(QSize const& size)
+{
+    QImage image(size, QImage::Format_RGBA8888);
+    QRandomGenerator random(42);
+    for (int y = 0; y < size.height(); ++y) {
+        quint32* row = reinterpret_cast<quint32*>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            row[x] = random.generate() | 0xff000000;
+        }
+    }
+    return image;
+}
+
+void MaskPathTest::initTestCase()
+{
+    if (!m_gl.create(3, 3)) {
+        QSKIP("No OpenGL 3.3 context");
+    }
+    qInfo() << "Renderer:" << m_gl.renderer();
+
+    m_program = m_gl.program(OffscreenGL::shaderSource(QStringLiteral("blur/shaders/vertex_core.vert")),
+                             OffscreenGL::shaderSource(QStringLiteral("blur/shaders/final_core.frag")));
+    QVERIFY(m_program);
+
+    // The blurred backdrop is the first level of the pyramid, at half the size of the background rect
+    QSize const blurredSize = s_backgroundRect.size() / 2;
+    m_blurred = m_gl.texture(blurredSize, GL_RGBA8, noise(blurredSize));
+    m_target = m_gl.texture(s_targetSize, GL_RGBA8);
+    glGenFramebuffers(1, &m_framebuffer);
+    glGenVertexArrays(1, &m_vertexArray);
+    glGenBuffers(1, &m_vertexBuffer);
+    glBindVertexArray(m_vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void*>(2 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    // An opaque window without rounded corners or noise, the mask is all the final pass blends for.
+    // The vertices are given in clip space already.
+    GLfloat const identity[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    float const width = blurredSize.width();
+    float const height = blurredSize.height();
+    glUseProgram(m_program);
+    glUniformMatrix4fv(glGetUniformLocation(m_program, "modelViewProjectionMatrix"), 1, GL_FALSE, identity);
+    glUniform2f(glGetUniformLocation(m_program, "textureScale"), 1, 1);
+    glUniform2f(glGetUniformLocation(m_program, "textureOffset"), 0, 0);
+    glUniform1i(glGetUniformLocation(m_program, "texUnit"), 0);
+    glUniform1f(glGetUniformLocation(m_program, "offset"), 4.0f);
+    glUniform2f(glGetUniformLocation(m_program, "halfpixel"), 0.5f / width, 0.5f / height);
+    glUniform4f(glGetUniformLocation(m_program, "textureBounds"), 0.5f / width, 0.5f / height, (width - 0.5f) / width, (height - 0.5f) / height);
+    glUniform1f(glGetUniformLocation(m_program, "noiseStrength"), 0.0f);
+    glUniform1f(glGetUniformLocation(m_program, "noiseScale"), 1.0f);
+    glUniform1f(glGetUniformLocation(m_program, "opacity"), 1.0f);
+    glUniform1f(glGetUniformLocation(m_program, "cornerRadius"), 0.0f);
+    glUniform1i(glGetUniformLocation(m_program, "maskUnit"), 1);
+    glUniform4f(glGetUniformLocation(m_program, "maskRect"), s_backgroundRect.x(), s_backgroundRect.y(),
+                1.0f / s_backgroundRect.width(), 1.0f / s_backgroundRect.height());
+    glUseProgram(0);
+}
+
+void MaskPathTest::cleanupTestCase()
+{
+    glDeleteBuffers(1, &m_vertexBuffer);
+    glDeleteVertexArrays(1, &m_vertexArray);
+    glDeleteFramebuffers(1, &m_framebuffer);
+    for (GLuint texture : { m_blurred, m_target, m_mask }) {
+        glDeleteTextures(1, &texture);
+    }
+    glDeleteProgram(m_program);
+}
+
+// The geometry and the mask as updateGeometry() and updateMask() build them
+void MaskPathTest::prepare(QList<QRect> const& shape, bool masked)
+{
+    auto appendQuad = [](std::vector<GLfloat>& vertices, QRect const& rect) {
+        float const x0 = 2.0f * rect.x() / s_targetSize.width() - 1.0f;
+        float const y0 = 2.0f * rect.y() / s_targetSize.height() - 1.0f;
+        float const x1 = 2.0f * (rect.x() + rect.width()) / s_targetSize.width() - 1.0f;
+        float const y1 = 2.0f * (rect.y() + rect.height()) / s_targetSize.height() - 1.0f;
+        float const u0 = float(rect.x() - s_backgroundRect.x()) / s_backgroundRect.width();
+        float const v0 = float(rect.y() - s_backgroundRect.y()) / s_backgroundRect.height();
+        float const u1 = float(rect.x() + rect.width() - s_backgroundRect.x()) / s_backgroundRect.width();
+        float const v1 = float(rect.y() + rect.height() - s_backgroundRect.y()) / s_backgroundRect.height();
+        vertices.insert(vertices.end(), { x0, y0, u0, v0, x1, y0, u1, v0, x0, y1, u0, v1,
+                                          x1, y0, u1, v0, x1, y1, u1, v1, x0, y1, u0, v1 });
+    };
+
+    std::vector<GLfloat> vertices;
+    if (masked) {
+        appendQuad(vertices, s_backgroundRect);
+
+        QImage mask(s_backgroundRect.size(), QImage::Format_Grayscale8);
+        mask.fill(0);
+        for (QRect const& rect : shape) {
+            for (int y = rect.top(); y <= rect.bottom(); ++y) {
+                uchar* row = mask.scanLine(y - s_backgroundRect.y());
+                std::fill(row + rect.left() - s_backgroundRect.x(), row + rect.right() + 1 - s_backgroundRect.x(), 0xff);
+            }
+        }
+        glDeleteTextures(1, &m_mask);
+        m_mask = m_gl.texture(s_backgroundRect.size(), GL_R8, mask);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    } else {
+        for (QRect const& rect : shape) {
+            appendQuad(vertices, rect);
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertices.size() * sizeof(GLfloat)), vertices.data(), GL_STATIC_DRAW);
+    m_vertexCount = int(vertices.size() / 4);
+    m_masked = masked;
+}
+
+void MaskPathTest::draw()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_target, 0);
+    glViewport(0, 0, s_targetSize.width(), s_targetSize.height());
+    glUseProgram(m_program);
+    glUniform1f(glGetUniformLocation(m_program, "maskEnabled"), m_masked ? 1.0f : 0.0f);
+
+    // Only the masked draw blends, as in BlurEffect for an opaque window without rounded corners
+    if (m_masked) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_mask);
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    glBindTexture(GL_TEXTURE_2D, m_blurred);
+    glBindVertexArray(m_vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, m_vertexCount);
+    glDisable(GL_BLEND);
+
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void MaskPathTest::samePixels_data()
+{
+    QTest::addColumn<int>("rects");
+
+    QTest::newRow("few") << 5;
+    QTest::newRow("many") << 300;
+}
+
+void MaskPathTest::samePixels()
+{
+    QFETCH(int, rects);
+
+    QList<QRect> const shape = stripes(rects);
+    QImage const background = noise(s_targetSize);
+    QImage results[2];
+    for (bool masked : { false, true }) {
+        glDeleteTextures(1, &m_target);
+        m_target = m_gl.texture(s_targetSize, GL_RGBA8, background);
+        prepare(shape, masked);
+        draw();
+        results[masked] = m_gl.read(m_target, s_targetSize);
+    }
+
+    // The texture coordinates of the quads are interpolated from other corners, they may round apart
+    int const difference = maxDifference(results[0], results[1]);
+    QVERIFY2(difference <= 1, qPrintable(QStringLiteral("The masked draw differs by %1").arg(difference)));
+}
+
+void MaskPathTest::benchmarkFinalPass_data()
+{
+    QTest::addColumn<bool>("masked");
+    QTest::addColumn<int>("rects");
+
+    for (int rects : { 16, 32, 48, 64, 80, 96, 112, 128, 256, 512 }) {
+        QTest::addRow("quads %d rects", rects) << false << rects;
+        QTest::addRow("mask %d rects", rects) << true << rects;
+    }
+}
+
+// The mask is built and uploaded only when the shape changes, a frame only pays for the draw
+void MaskPathTest::benchmarkFinalPass()
+{
+    QFETCH(bool, masked);
+    QFETCH(int, rects);
+
+    prepare(stripes(rects), masked);
+    draw();
+    glFinish();
+
+    QBENCHMARK {
+        draw();
+        glFinish();
+    }
+}
+
+QTEST_MAIN(MaskPathTest)
+
+#include "maskpathtest.moc"
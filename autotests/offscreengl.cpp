@@ -0,0 +1,221 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "offscreengl.h"
+
+#include <QFile>
+#include <QTest>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace Lightly {
+    static bool checkShader(GLuint shader)
+    {
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE) {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            QByteArray log(std::max(length, 1), '\0');
+            glGetShaderInfoLog(shader, log.size(), nullptr, log.data());
+            qWarning() << "Failed to compile shader:" << log.constData();
+        }
+        return status == GL_TRUE;
+    }
+
+    static GLuint compile(GLenum type, QByteArray const& source)
+    {
+        GLuint const shader = glCreateShader(type);
+        char const* data = source.constData();
+        glShaderSource(shader, 1, &data, nullptr);
+        glCompileShader(shader);
+        if (!checkShader(shader)) {
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    static GLuint link(GLuint program)
+    {
+        glLinkProgram(program);
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE) {
+            qWarning() << "Failed to link shader program";
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    OffscreenGL::~OffscreenGL()
+    {
+        if (!m_context) {
+            return;
+        }
+        m_context->makeCurrent(&m_surface);
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteBuffers(1, &m_vertexBuffer);
+        glDeleteVertexArrays(1, &m_vertexArray);
+        m_context->doneCurrent();
+    }
+
+    bool OffscreenGL::create(int major, int minor)
+    {
+        QSurfaceFormat format;
+        format.setVersion(major, minor);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+
+        m_surface.setFormat(format);
+        m_surface.create();
+
+        m_context = std::make_unique<QOpenGLContext>();
+        m_context->setFormat(format);
+        if (!m_context->create() || m_context->format().version() < std::make_pair(major, minor)
+            || !m_context->makeCurrent(&m_surface)) {
+            m_context.reset();
+            return false;
+        }
+
+        // A quad covering the target as a triangle strip, with the texture coordinates
+        static GLfloat const vertices[] = {
+            -1.0f, -1.0f, 0.0f, 0.0f,
+            1.0f, -1.0f, 1.0f, 0.0f,
+            -1.0f, 1.0f, 0.0f, 1.0f,
+            1.0f, 1.0f, 1.0f, 1.0f,
+        };
+        glGenVertexArrays(1, &m_vertexArray);
+        glBindVertexArray(m_vertexArray);
+        glGenBuffers(1, &m_vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<void*>(2 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+
+        glGenFramebuffers(1, &m_framebuffer);
+        return true;
+    }
+
+    QString OffscreenGL::renderer() const
+    {
+        return QString::fromUtf8(reinterpret_cast<char const*>(glGetString(GL_RENDERER)));
+    }
+
+    QByteArray OffscreenGL::shaderSource(QString const& path)
+    {
+        QFile file(QTest::qFindTestData(QStringLiteral("../src/") + path, __FILE__, __LINE__));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Failed to read" << path;
+            return QByteArray();
+        }
+        return file.readAll();
+    }
+
+    GLuint OffscreenGL::program(QByteArray const& vertex, QByteArray const& fragment)
+    {
+        GLuint const vertexShader = compile(GL_VERTEX_SHADER, vertex);
+        GLuint const fragmentShader = compile(GL_FRAGMENT_SHADER, fragment);
+        if (!vertexShader || !fragmentShader) {
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+            return 0;
+        }
+
+        GLuint const program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+        glAttachShader(program, fragmentShader);
+        glBindAttribLocation(program, 0, "position");
+        glBindAttribLocation(program, 1, "texcoord");
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return link(program);
+    }
+
+    GLuint OffscreenGL::computeProgram(QByteArray const& source)
+    {
+        GLuint const shader = compile(GL_COMPUTE_SHADER, source);
+        if (!shader) {
+            return 0;
+        }
+
+        GLuint const program = glCreateProgram();
+        glAttachShader(program, shader);
+        glDeleteShader(shader);
+        return link(program);
+    }
+
+    GLuint OffscreenGL::texture(QSize const& size, GLenum format, QImage const& content)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (content.format() == QImage::Format_RGBA32FPx4) {
+            glTexImage2D(GL_TEXTURE_2D, 0, format, size.width(), size.height(), 0, GL_RGBA, GL_FLOAT, content.constBits());
+            return texture;
+        }
+
+        QImage const pixels = content.isNull() ? QImage() : content.convertToFormat(QImage::Format_RGBA8888);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, size.width(), size.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.isNull() ? nullptr : pixels.constBits());
+        return texture;
+    }
+
+    void OffscreenGL::draw(GLuint program, GLuint target, QSize const& size)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+        glViewport(0, 0, size.width(), size.height());
+        glUseProgram(program);
+        glBindVertexArray(m_vertexArray);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glUseProgram(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    QImage OffscreenGL::read(GLuint texture, QSize const& size)
+    {
+        QImage image(size, QImage::Format_RGBA8888);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.bits());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return image;
+    }
+
+    QImage OffscreenGL::readFloat(GLuint texture, QSize const& size)
+    {
+        QImage image(size, QImage::Format_RGBA32FPx4);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_FLOAT, image.bits());
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return image;
+    }
+
+    int maxDifference(QImage const& a, QImage const& b)
+    {
+        int difference = 0;
+        for (int y = 0; y < a.height(); ++y) {
+            uchar const* rowA = a.constScanLine(y);
+            uchar const* rowB = b.constScanLine(y);
+            for (int x = 0; x < a.width() * 4; ++x) {
+                difference = std::max(difference, std::abs(rowA[x] - rowB[x]));
+            }
+        }
+        return difference;
+    }
+} // namespace Lightly
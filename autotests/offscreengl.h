@@ -0,0 +1,56 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <epoxy/gl.h>
+
+#include <QByteArray>
+#include <QImage>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+
+#include <memory>
+
+namespace Lightly {
+    /// An OpenGL context on an offscreen surface and the bits the shader tests share. The shaders are
+    /// read from the source tree, draws cover the whole target with a quad.
+    class OffscreenGL {
+    public:
+        OffscreenGL() = default;
+        ~OffscreenGL();
+
+        /// Creates a core profile context of at least the given version and makes it current
+        bool create(int major, int minor);
+        QString renderer() const;
+
+        /// A shader of the effects, the path is relative to src/
+        static QByteArray shaderSource(QString const& path);
+
+        /// The vertices have the attributes position, in clip space, and texcoord
+        GLuint program(QByteArray const& vertex, QByteArray const& fragment);
+        GLuint computeProgram(QByteArray const& source);
+
+        /// Float content is uploaded as floats, anything else as RGBA8888
+        GLuint texture(QSize const& size, GLenum format, QImage const& content = QImage());
+        void draw(GLuint program, GLuint target, QSize const& size);
+
+        /// The texels of a texture as RGBA8888, the first row is the bottom one as in OpenGL
+        QImage read(GLuint texture, QSize const& size);
+        /// The same as RGBA32FPx4, for formats with more precision than 8 bits
+        QImage readFloat(GLuint texture, QSize const& size);
+
+    private:
+        QOffscreenSurface m_surface;
+        std::unique_ptr<QOpenGLContext> m_context;
+        GLuint m_vertexArray = 0;
+        GLuint m_vertexBuffer = 0;
+        GLuint m_framebuffer = 0;
+    };
+
+    /// The largest difference of any channel between two images of the same size
+    int maxDifference(QImage const& a, QImage const& b);
+} // namespace Lightly
@@ -0,0 +1,228 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "tilemask.h"
+
+#include <QRandomGenerator>
+#include <QTest>
+
+#include <vector>
+
+using namespace Lightly;
+
+// TileMask may only err on the larger side: whatever the exact region covers, the mask covers too,
+// and it never covers a tile no rect has touched
+class TileMaskTest : public QObject {
+    Q_OBJECT
+
+private Q_SLOTS:
+    void conservative_data();
+    void conservative();
+    void aligned();
+    void prePaintWindows_data();
+    void prePaintWindows();
+};
+
+static QRect randomRect(QRandomGenerator& random, QRect const& area)
+{
+    // Rects may reach past the area on every side
+    int const x = area.x() + random.bounded(-100, area.width());
+    int const y = area.y() + random.bounded(-100, area.height());
+    return QRect(x, y, random.bounded(1, area.width() / 2), random.bounded(1, area.height() / 2));
+}
+
+// The tiles a region touches, the largest a mask built from it may be
+static QRegion touchedTiles(QRegion const& region, QRect const& area)
+{
+    int const tile = TileMask::s_tileSize;
+    QRegion tiles;
+    for (QRect const& rect : region & area) {
+        int const left = area.x() + (rect.x() - area.x()) / tile * tile;
+        int const top = area.y() + (rect.y() - area.y()) / tile * tile;
+        int const right = area.x() + (rect.x() + rect.width() - area.x() + tile - 1) / tile * tile;
+        int const bottom = area.y() + (rect.y() + rect.height() - area.y() + tile - 1) / tile * tile;
+        tiles += QRect(left, top, right - left, bottom - top);
+    }
+    return tiles & area;
+}
+
+void TileMaskTest::conservative_data()
+{
+    QTest::addColumn<QRect>("area");
+    QTest::addColumn<quint32>("seed");
+
+    QTest::newRow("screen") << QRect(0, 0, 1920, 1080) << 1u;
+    QTest::newRow("offset") << QRect(1920, -200, 1000, 700) << 2u;
+    QTest::newRow("wide") << QRect(-3000, 0, 5120, 1440) << 3u;
+    QTest::newRow("small") << QRect(7, 13, 50, 40) << 4u;
+}
+
+void TileMaskTest::conservative()
+{
+    QFETCH(QRect, area);
+    QFETCH(quint32, seed);
+
+    QRandomGenerator random(seed);
+    TileMask mask;
+    for (int run = 0; run < 50; ++run) {
+        mask.reset(area);
+        QRegion exact;
+        QRegion added;
+        for (int step = 0; step < 20; ++step) {
+            QRect const rect = randomRect(random, area);
+            if (random.bounded(3) == 0) {
+                QRegion const covered = QRegion(rect) + randomRect(random, area);
+                mask.subtractCovered(covered);
+                exact -= covered;
+            } else {
+                mask.add(rect);
+                exact += rect;
+                added += rect;
+            }
+
+            QRegion const region = mask.toRegion();
+            QVERIFY((exact & area).subtracted(region).isEmpty());
+            QVERIFY(region.subtracted(touchedTiles(added, area)).isEmpty());
+
+            QRect const clip = randomRect(random, area);
+            QRegion const clipped = mask.toRegion(clip);
+            QVERIFY((exact & area & clip).subtracted(clipped).isEmpty());
+            QVERIFY(clipped.subtracted(region & clip).isEmpty());
+
+            // Past the area the mask knows nothing, tiles cut by its edge are only compared inside
+            QRect const probe = randomRect(random, area) & area;
+            if ((exact & area).intersects(probe)) {
+                QVERIFY(mask.intersects(probe));
+            }
+            QCOMPARE(mask.intersects(probe), region.intersects(probe));
+        }
+    }
+}
+
+void TileMaskTest::aligned()
+{
+    // With rects on tile edges the mask is exact
+    int const tile = TileMask::s_tileSize;
+    QRect const area(-64, 32, 40 * tile, 24 * tile);
+    QRandomGenerator random(5);
+    TileMask mask;
+    mask.reset(area);
+    QRegion exact;
+    for (int step = 0; step < 200; ++step) {
+        QRect const rect(area.x() + random.bounded(-2, 40) * tile, area.y() + random.bounded(-2, 24) * tile,
+                         random.bounded(1, 12) * tile, random.bounded(1, 12) * tile);
+        if (random.bounded(3) == 0) {
+            mask.subtractCovered(rect);
+            exact -= rect;
+        } else {
+            mask.add(rect);
+            exact += rect;
+        }
+        QCOMPARE(mask.toRegion(), exact & area);
+
+        QRect const probe = randomRect(random, area);
+        QCOMPARE(mask.intersects(probe), (exact & area).intersects(probe));
+    }
+}
+
+// A stack of windows the way prePaintWindow sees them from bottom to top, each with a repaint,
+// an opaque part and a blurred area
+struct Window {
+    QRegion paint;
+    QRegion opaque;
+    QRect blur;
+};
+
+static std::vector<Window> windowStack(QRect const& screen, int count)
+{
+    QRandomGenerator random(6);
+    std::vector<Window> windows;
+    for (int i = 0; i < count; ++i) {
+        QRect const frame = randomRect(random, screen);
+        Window& window = windows.emplace_back();
+        window.paint = random.bounded(2) ? QRegion(frame) : QRegion(randomRect(random, frame.adjusted(0, 0, 100, 100)) & frame);
+        window.opaque = random.bounded(2) ? QRegion(frame.adjusted(12, 12, -12, -12)) : QRegion();
+        window.blur = random.bounded(2) ? frame : QRect();
+    }
+    return windows;
+}
+
+void TileMaskTest::prePaintWindows_data()
+{
+    QTest::addColumn<bool>("tiles");
+    QTest::addColumn<int>("count");
+
+    for (int count : {10, 50, 200}) {
+        QTest::addRow("QRegion %d windows", count) << false << count;
+        QTest::addRow("TileMask %d windows", count) << true << count;
+    }
+}
+
+// The region bookkeeping of prePaintWindow, without the blur kernels and the shared blurs
+void TileMaskTest::prePaintWindows()
+{
+    QFETCH(bool, tiles);
+    QFETCH(int, count);
+
+    QRect const screen(0, 0, 3840, 2160);
+    std::vector<Window> const windows = windowStack(screen, count);
+    QRegion paint;
+
+    if (tiles) {
+        TileMask paintedArea;
+        TileMask currentBlur;
+        QBENCHMARK {
+            paintedArea.reset(screen);
+            currentBlur.reset(screen);
+            for (Window const& window : windows) {
+                paint = window.paint;
+                if (currentBlur.intersects(window.opaque)) {
+                    currentBlur.subtractCovered(window.opaque);
+                }
+                if (currentBlur.intersects(paint - window.opaque)) {
+                    paint += currentBlur.toRegion();
+                }
+                if (paintedArea.intersects(window.blur) || paint.intersects(window.blur)) {
+                    paint += window.blur;
+                    if (currentBlur.intersects(window.blur)) {
+                        paint += currentBlur.toRegion();
+                    }
+                }
+                currentBlur.add(window.blur);
+                paintedArea.subtractCovered(window.opaque);
+                paintedArea.add(paint);
+            }
+        }
+    } else {
+        QBENCHMARK {
+            QRegion paintedArea;
+            QRegion currentBlur;
+            for (Window const& window : windows) {
+                paint = window.paint;
+                if (currentBlur.intersects(window.opaque)) {
+                    currentBlur -= window.opaque;
+                }
+                if (currentBlur.intersects(paint - window.opaque)) {
+                    paint += currentBlur;
+                }
+                if (paintedArea.intersects(window.blur) || paint.intersects(window.blur)) {
+                    paint += window.blur;
+                    if (currentBlur.intersects(window.blur)) {
+                        paint += currentBlur;
+                    }
+                }
+                currentBlur += window.blur;
+                paintedArea -= window.opaque;
+                paintedArea += paint;
+            }
+        }
+    }
+    QVERIFY(!paint.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TileMaskTest)
+
+#include "tilemasktest.moc"
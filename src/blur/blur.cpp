@@ -10,6 +10,7 @@
 // KConfigSkeleton
 #include "blurconfig.h"
 
+#include "core/output.h"
 #include "core/pixelgrid.h"
 #include "core/rendertarget.h"
 #include "core/renderviewport.h"
@@ -26,14 +27,16 @@
 #    include "utils/xcbutils.h"
 #endif
 
+#include <QDBusConnection>
+#include <QElapsedTimer>
 #include <QGuiApplication>
+#include <QHash>
 #include <QMatrix4x4>
+#include <QPainter>
 #include <QScreen>
-#include <QTime>
 #include <QTimer>
 #include <QWindow>
 #include <cmath> // for ceil()
-#include <cstdlib>
 
 #include <KConfigGroup>
 #include <KSharedConfig>
@@ -51,6 +54,12 @@ static void ensureResources()
 namespace Lightly {
 
     static QByteArray const s_blurAtomName = QByteArrayLiteral("_KDE_NET_WM_BLUR_BEHIND_REGION");
+    static QByteArray const s_strengthAtomName = QByteArrayLiteral("_LIGHTLY_BLUR_STRENGTH");
+
+    // The strength calibration starts this long after the effect was loaded, in ms, and times pyramids of this size
+    static constexpr int s_calibrationDelay = 30000;
+    static constexpr QSize s_calibrationSize(1280, 800);
+    static QString const s_dbusPath = QStringLiteral("/LightlyShadersBlur");
 
     KWin::BlurManagerInterface* BlurEffect::s_blurManager = nullptr;
     QTimer* BlurEffect::s_blurManagerRemoveTimer = nullptr;
@@ -62,51 +71,32 @@ namespace Lightly {
 
         m_helper = new LSHelper();
 
-        m_downsamplePass.shader = KWin::ShaderManager::instance()->generateShaderFromFile(
-            KWin::ShaderTrait::MapTexture,
-            QStringLiteral(":/effects/blur/shaders/vertex.vert"),
-            QStringLiteral(":/effects/blur/shaders/downsample.frag")
-        );
-        if (!m_downsamplePass.shader) {
-            qCWarning(KWIN_BLUR) << "Failed to load downsampling pass shader";
-            return;
-        }
-        m_downsamplePass.mvpMatrixLocation = m_downsamplePass.shader->uniformLocation("modelViewProjectionMatrix");
-        m_downsamplePass.offsetLocation = m_downsamplePass.shader->uniformLocation("offset");
-        m_downsamplePass.halfpixelLocation = m_downsamplePass.shader->uniformLocation("halfpixel");
-
-        m_upsamplePass.shader = KWin::ShaderManager::instance()->generateShaderFromFile(
-            KWin::ShaderTrait::MapTexture,
-            QStringLiteral(":/effects/blur/shaders/vertex.vert"),
-            QStringLiteral(":/effects/blur/shaders/upsample.frag")
-        );
-        if (!m_upsamplePass.shader) {
-            qCWarning(KWIN_BLUR) << "Failed to load upsampling pass shader";
-            return;
-        }
-        m_upsamplePass.mvpMatrixLocation = m_upsamplePass.shader->uniformLocation("modelViewProjectionMatrix");
-        m_upsamplePass.offsetLocation = m_upsamplePass.shader->uniformLocation("offset");
-        m_upsamplePass.halfpixelLocation = m_upsamplePass.shader->uniformLocation("halfpixel");
+        m_calibrationTimer.setSingleShot(true);
+        m_calibrationTimer.setInterval(s_calibrationDelay);
+        m_calibrationTimer.callOnTimeout(this, &BlurEffect::calibrateStrengths);
 
-        m_noisePass.shader = KWin::ShaderManager::instance()->generateShaderFromFile(
-            KWin::ShaderTrait::MapTexture,
-            QStringLiteral(":/effects/blur/shaders/vertex.vert"),
-            QStringLiteral(":/effects/blur/shaders/noise.frag")
-        );
-        if (!m_noisePass.shader) {
-            qCWarning(KWIN_BLUR) << "Failed to load noise pass shader";
-            return;
+        // Without OpenGL the backdrop is blurred on the CPU and painted with the scene painter
+        if (KWin::effects->isOpenGLCompositing()) {
+            if (!initOpenGL()) {
+                return;
+            }
+        } else {
+            m_cpuBlur = std::make_unique<CpuBlur>();
         }
-        m_noisePass.mvpMatrixLocation = m_noisePass.shader->uniformLocation("modelViewProjectionMatrix");
-        m_noisePass.noiseTextureSizeLocation = m_noisePass.shader->uniformLocation("noiseTextureSize");
-        m_noisePass.texStartPosLocation = m_noisePass.shader->uniformLocation("texStartPos");
 
         initBlurStrengthValues();
+        m_defaultStrengthValues = blurStrengthValues;
         BlurEffect::reconfigure(ReconfigureAll);
 
+        // The calibration can be started again with: qdbus org.kde.KWin /LightlyShadersBlur calibrateStrengths
+        if (m_calibration) {
+            QDBusConnection::sessionBus().registerObject(s_dbusPath, this, QDBusConnection::ExportScriptableSlots);
+        }
+
 #if KWIN_BUILD_X11
         if (KWin::effects->xcbConnection()) {
             net_wm_blur_region = KWin::effects->announceSupportProperty(s_blurAtomName, this);
+            net_wm_blur_strength = KWin::effects->announceSupportProperty(s_strengthAtomName, this);
         }
 #endif
 
@@ -125,13 +115,31 @@ namespace Lightly {
             }
         }
 
+        m_deferredBlurTimer.setSingleShot(true);
+        m_deferredBlurTimer.callOnTimeout(this, [this]() {
+            KWin::effects->addRepaint(m_deferredBlurArea);
+            m_deferredBlurArea = QRegion();
+        });
+
         connect(KWin::effects, &KWin::EffectsHandler::windowAdded, this, &BlurEffect::slotWindowAdded);
         connect(KWin::effects, &KWin::EffectsHandler::windowDeleted, this, &BlurEffect::slotWindowDeleted);
         connect(KWin::effects, &KWin::EffectsHandler::screenRemoved, this, &BlurEffect::slotScreenRemoved);
+        // Windows disappearing or changing their stacking order repaint the screen without any
+        // window damage, the cached blur behind them has to be dropped explicitly.
+        connect(KWin::effects, &KWin::EffectsHandler::windowClosed, this, &BlurEffect::slotWindowVisibilityChanged);
+        connect(KWin::effects, &KWin::EffectsHandler::windowMinimized, this, &BlurEffect::slotWindowVisibilityChanged);
+        connect(KWin::effects, &KWin::EffectsHandler::windowUnminimized, this, &BlurEffect::slotWindowVisibilityChanged);
+        connect(KWin::effects, &KWin::EffectsHandler::stackingOrderChanged, this, [this]() {
+            discardCachedBlur(KWin::infiniteRegion());
+        });
+        connect(KWin::effects, &KWin::EffectsHandler::desktopChanged, this, [this]() {
+            discardCachedBlur(KWin::infiniteRegion());
+        });
 #if KWIN_BUILD_X11
         connect(KWin::effects, &KWin::EffectsHandler::propertyNotify, this, &BlurEffect::slotPropertyNotify);
         connect(KWin::effects, &KWin::EffectsHandler::xcbConnectionChanged, this, [this]() {
             net_wm_blur_region = KWin::effects->announceSupportProperty(s_blurAtomName, this);
+            net_wm_blur_strength = KWin::effects->announceSupportProperty(s_strengthAtomName, this);
         });
 #endif
 
@@ -146,19 +154,133 @@ namespace Lightly {
 
     BlurEffect::~BlurEffect()
     {
+        if (m_calibration) {
+            QDBusConnection::sessionBus().unregisterObject(s_dbusPath);
+        }
+
         // When compositing is restarted, avoid removing the manager immediately.
         if (s_blurManager) {
             s_blurManagerRemoveTimer->start(1000);
         }
     }
 
+    static bool floatRenderable()
+    {
+        return epoxy_is_desktop_gl() || epoxy_has_gl_extension("GL_EXT_color_buffer_float");
+    }
+
+    GLenum BlurEffect::intermediateFormat(GLenum outputFormat) const
+    {
+        switch (m_intermediateFormat) {
+        case KWin::BlurConfig::EnumIntermediateFormat::RGBA8:
+            return GL_RGBA8;
+        case KWin::BlurConfig::EnumIntermediateFormat::RGB10_A2:
+            return GL_RGB10_A2;
+        case KWin::BlurConfig::EnumIntermediateFormat::R11F_G11F_B10F:
+            return floatRenderable() ? GL_R11F_G11F_B10F : outputFormat;
+        case KWin::BlurConfig::EnumIntermediateFormat::RGBA16F:
+            return floatRenderable() ? GL_RGBA16F : outputFormat;
+        default:
+            break;
+        }
+
+        // Automatic: as precise as the output, but no wider. The final pass doesn't use the alpha of the
+        // blurred backdrop, so float outputs can use the packed format without alpha.
+        switch (outputFormat) {
+        case GL_RGBA16F:
+        case GL_RGB16F:
+        case GL_RGBA32F:
+        case GL_RGB32F:
+            return floatRenderable() ? GL_R11F_G11F_B10F : outputFormat;
+        case GL_RGB10_A2:
+        case GL_RGB10:
+        case GL_RGBA16:
+            return GL_RGB10_A2;
+        default:
+            return GL_RGBA8;
+        }
+    }
+
+    BlurKernel BlurEffect::kernel(int strength) const
+    {
+        // Every step below full quality drops a downsample iteration and doubles the offset as far as
+        // the fewer iterations allow without artifacts, which keeps the blur radius about the same.
+        // The expand size of the strength is kept, it covers all the cheaper settings.
+        BlurValuesStruct const& values = blurStrengthValues[std::clamp(strength, 1, int(blurStrengthValues.size())) - 1];
+        int const level = std::min(m_governor.level(), values.iteration - 1);
+
+        BlurKernel kernel;
+        kernel.iterationCount = values.iteration - level;
+        kernel.offset = std::min(values.offset * (1 << level), blurOffsets[kernel.iterationCount - 1].maxOffset);
+        kernel.expandSize = blurOffsets[values.iteration - 1].expandSize;
+        return kernel;
+    }
+
+    BlurKernel BlurEffect::kernelFor(BlurEffectData const& blurInfo) const
+    {
+        return blurInfo.strength > 0 ? kernel(blurInfo.strength) : m_kernel;
+    }
+
+    void BlurEffect::applyQualityLevel()
+    {
+        m_kernel = kernel(m_blurStrength);
+
+        // The blurred desktops were made with the old settings
+        for (auto& [desktop, screens] : m_desktopBlurs) {
+            for (auto& [screen, desktopBlur] : screens) {
+                desktopBlur.valid = false;
+            }
+        }
+    }
+
+    // The largest margin kept around blurred areas, in logical pixels. Opaque windows shrink by it before they hide
+    // anything and damage grows by it, so the deepest levels would turn most repaints into full screen ones. Their
+    // kernels reach further, at the edges of the blur they read the clamped border of the backdrop instead.
+    static constexpr int s_maxExpandSize = 192;
+
+    // Variance of the taps of a pass along one axis, in texels² of the level it reads, for an offset of one.
+    // Downsampling: 4 diagonal taps at half the offset around a center tap of weight 4, 4 * 1/8 * (1/2)².
+    // Upsampling: 4 taps at the offset and 4 diagonal taps of weight 2 at half of it, 2 * 1/12 * 1² + 4 * 2/12 * (1/2)².
+    static constexpr double s_downsampleTapVariance = 1.0 / 8.0;
+    static constexpr double s_upsampleTapVariance = 1.0 / 3.0;
+
+    // The reduced passes read four equal taps at (±d, ±d), their variance along an axis is d². At d = σ of the
+    // regular taps the kernel keeps its variance, so the strengths look the same: 1/√2 of halfpixel * offset when
+    // downsampling and 2/√3 when upsampling. The shaders get d in units of halfpixel * offset, half an offset in texels.
+    static float reducedTapSpread(double tapVariance)
+    {
+        return float(2.0 * std::sqrt(tapVariance));
+    }
+
+    // Variance of the dual Kawase kernel in full resolution pixels². The passes are convolved one after another,
+    // so their variances add up: the taps of every pass plus its bilinear filtering, in texels of the level it reads.
+    static double kernelVariance(int iterations, double offset)
+    {
+        double variance = 0.0;
+        for (int i = 1; i <= iterations; ++i) {
+            // The downsampling taps are read between two texels
+            double const texel = 1 << (i - 1);
+            variance += texel * texel * (offset * offset * s_downsampleTapVariance + 0.25);
+        }
+        for (int i = 0; i < iterations; ++i) {
+            // The upsampling taps are read at a quarter of a texel
+            double const texel = 1 << (i + 1);
+            variance += texel * texel * (offset * offset * s_upsampleTapVariance + 0.1875);
+        }
+        return variance;
+    }
+
     void BlurEffect::initBlurStrengthValues()
     {
         // This function creates an array of blur strength values that are evenly distributed
 
-        // The range of the slider on the blur settings UI
+        // The first 15 steps of the slider on the blur settings UI are spread over the first four levels
+        // as they always were, so stored strengths keep their look. The deeper levels add the stronger
+        // steps above them, 20 in all.
         int numOfBlurSteps = 15;
+        int numOfClassicLevels = 4;
         int remainingSteps = numOfBlurSteps;
+        QList<int> const deepLevelSteps = { 2, 3 };
 
         /*
          * Explanation for these numbers:
@@ -174,40 +296,240 @@ namespace Lightly {
          * The maxOffset value is the maximum offset value for an iteration before we
          * get diagonal line artifacts because of the nature of the dual kawase blur algorithm.
          *
-         * The expandSize value is the minimum value for an iteration before we reach the end
-         * of a texture in the shader and sample outside of the area that was copied into the
-         * texture from the screen.
+         * The expandSize value is how far the kernel reaches at the maximum offset. Beyond it the
+         * shaders would sample outside of the area that was copied into the texture from the screen.
+         * It's two standard deviations of the kernel, which holds 95% of its weight, but at most
+         * s_maxExpandSize.
          */
 
-        // {minOffset, maxOffset, expandSize}
-        blurOffsets.append({ 1.0, 2.0, 10 });  // Down sample size / 2
-        blurOffsets.append({ 2.0, 3.0, 20 });  // Down sample size / 4
-        blurOffsets.append({ 2.0, 5.0, 50 });  // Down sample size / 8
-        blurOffsets.append({ 3.0, 8.0, 150 }); // Down sample size / 16
-        // blurOffsets.append({5.0, 10.0, 400}); // Down sample size / 32
-        // blurOffsets.append({7.0, ?.0});       // Down sample size / 64
+        // {minOffset, maxOffset}, the offset limits are visual and have been found by testing
+        blurOffsets.append({ 1.0, 2.0 });  // Down sample size / 2
+        blurOffsets.append({ 2.0, 3.0 });  // Down sample size / 4
+        blurOffsets.append({ 2.0, 5.0 });  // Down sample size / 8
+        blurOffsets.append({ 3.0, 8.0 });  // Down sample size / 16
+        blurOffsets.append({ 5.0, 10.0 }); // Down sample size / 32
+        blurOffsets.append({ 7.0, 14.0 }); // Down sample size / 64
+
+        for (int i = 0; i < blurOffsets.size(); i++) {
+            int const expandSize = std::ceil(2.0 * std::sqrt(kernelVariance(i + 1, blurOffsets[i].maxOffset)));
+            blurOffsets[i].expandSize = std::min(expandSize, s_maxExpandSize);
+        }
 
         float offsetSum = 0;
 
-        for (int i = 0; i < blurOffsets.size(); i++) {
+        for (int i = 0; i < numOfClassicLevels; i++) {
             offsetSum += blurOffsets[i].maxOffset - blurOffsets[i].minOffset;
         }
 
         for (int i = 0; i < blurOffsets.size(); i++) {
-            int iterationNumber = std::ceil((blurOffsets[i].maxOffset - blurOffsets[i].minOffset) / offsetSum * numOfBlurSteps);
-            remainingSteps -= iterationNumber;
+            float offsetDifference = blurOffsets[i].maxOffset - blurOffsets[i].minOffset;
 
-            if (remainingSteps < 0) {
-                iterationNumber += remainingSteps;
-            }
+            int iterationNumber;
+            if (i < numOfClassicLevels) {
+                iterationNumber = std::ceil(offsetDifference / offsetSum * numOfBlurSteps);
+                remainingSteps -= iterationNumber;
 
-            float offsetDifference = blurOffsets[i].maxOffset - blurOffsets[i].minOffset;
+                if (remainingSteps < 0) {
+                    iterationNumber += remainingSteps;
+                }
+            } else {
+                iterationNumber = deepLevelSteps[i - numOfClassicLevels];
+            }
 
             for (int j = 1; j <= iterationNumber; j++) {
                 // {iteration, offset}
-                blurStrengthValues.append({ i + 1, blurOffsets[i].minOffset + (offsetDifference / iterationNumber) * j });
+                float const offset = blurOffsets[i].minOffset + (offsetDifference / iterationNumber) * j;
+                blurStrengthValues.append({ i + 1, offset });
+                m_strengthRadii.append(std::sqrt(kernelVariance(i + 1, offset)));
+            }
+        }
+    }
+
+    double BlurEffect::offsetForRadius(int iteration, double radius) const
+    {
+        double low = blurOffsets[iteration - 1].minOffset;
+        double high = blurOffsets[iteration - 1].maxOffset;
+        for (int k = 0; k < 20; k++) {
+            double const middle = (low + high) / 2.0;
+            if (std::sqrt(kernelVariance(iteration, middle)) < radius) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        return high;
+    }
+
+    std::vector<StrengthCalibration::Candidate> BlurEffect::calibrationCandidates() const
+    {
+        // Every level whose offsets reach the radius of a step looks the same, only their cost differs.
+        // The default level is always measured, the radius of the last steps can lie beyond its range.
+        std::vector<StrengthCalibration::Candidate> candidates;
+        for (int step = 0; step < m_strengthRadii.size(); step++) {
+            double const radius = m_strengthRadii[step];
+            int const defaultIteration = m_defaultStrengthValues[step].iteration;
+            for (int i = 0; i < blurOffsets.size(); i++) {
+                int const iteration = i + 1;
+                bool const reachable = std::sqrt(kernelVariance(iteration, blurOffsets[i].minOffset)) <= radius
+                    && std::sqrt(kernelVariance(iteration, blurOffsets[i].maxOffset)) >= radius;
+                if (reachable || iteration == defaultIteration) {
+                    candidates.push_back({ step + 1, { iteration, float(offsetForRadius(iteration, radius)) } });
+                }
+            }
+        }
+        return candidates;
+    }
+
+    QString BlurEffect::calibrationPipeline() const
+    {
+        QString const backend = m_computeBlur ? QStringLiteral("compute") : (m_reducedTaps ? QStringLiteral("reduced taps") : QStringLiteral("fragment"));
+        return QStringLiteral("%1, pyramid 0x%2, output 0x%3").arg(backend).arg(intermediateFormat(m_outputFormat), 0, 16).arg(m_outputFormat, 0, 16);
+    }
+
+    void BlurEffect::loadCalibration()
+    {
+        // The timings depend on the backend and the formats as much as on the GPU, every pipeline has a table of its own
+        if (!m_calibration) {
+            return;
+        }
+        QString const pipeline = calibrationPipeline();
+        if (pipeline == m_calibrationPipeline) {
+            return;
+        }
+        m_calibrationPipeline = pipeline;
+        if (m_calibration->isRunning()) {
+            m_calibration->cancel();
+            m_calibrationBlur.render = BlurRenderData();
+        }
+
+        blurStrengthValues = m_defaultStrengthValues;
+        QList<StrengthCalibration::Choice> const calibrated = m_calibration->load(pipeline, blurStrengthValues.size());
+        applyCalibration(calibrated);
+        m_governor.setMaximumLevel(blurStrengthValues[m_blurStrength - 1].iteration - 1);
+        applyQualityLevel();
+
+        // A pipeline is calibrated once, after the session had some time to settle
+        if (KWin::BlurConfig::calibrateStrengths() && calibrated.isEmpty()) {
+            m_calibrationTimer.start();
+        } else {
+            m_calibrationTimer.stop();
+        }
+    }
+
+    void BlurEffect::applyCalibration(QList<StrengthCalibration::Choice> const& choices)
+    {
+        for (int step = 0; step < choices.size() && step < blurStrengthValues.size(); step++) {
+            StrengthCalibration::Choice const& choice = choices[step];
+            if (choice.iteration < 1 || choice.iteration > blurOffsets.size()
+                || choice.offset < blurOffsets[choice.iteration - 1].minOffset || choice.offset > blurOffsets[choice.iteration - 1].maxOffset) {
+                qCWarning(KWIN_BLUR) << "Ignoring the calibrated blur strength" << step + 1;
+                continue;
             }
+            blurStrengthValues[step] = { choice.iteration, choice.offset };
+        }
+    }
+
+    void BlurEffect::calibrateStrengths()
+    {
+        if (m_calibration && !m_calibration->isRunning()) {
+            m_calibrationFormat = intermediateFormat(m_outputFormat);
+            m_calibrationOutputFormat = m_outputFormat;
+            m_calibration->start(m_calibrationPipeline, calibrationCandidates());
+        }
+    }
+
+    bool BlurEffect::initOpenGL()
+    {
+        if (!loadSamplingPass(m_downsamplePass, QStringLiteral(":/effects/blur/shaders/downsample.frag"))) {
+            qCWarning(KWIN_BLUR) << "Failed to load downsampling pass shader";
+            return false;
+        }
+        if (!loadSamplingPass(m_upsamplePass, QStringLiteral(":/effects/blur/shaders/upsample.frag"))) {
+            qCWarning(KWIN_BLUR) << "Failed to load upsampling pass shader";
+            return false;
+        }
+
+        // The reduced passes are optional, the regular ones are used without them
+        if (!loadSamplingPass(m_reducedDownsamplePass, QStringLiteral(":/effects/blur/shaders/downsample_reduced.frag"))
+            || !loadSamplingPass(m_reducedUpsamplePass, QStringLiteral(":/effects/blur/shaders/upsample_reduced.frag"))) {
+            qCWarning(KWIN_BLUR) << "Failed to load reduced sampling pass shaders";
+            m_reducedDownsamplePass.shader.reset();
+            m_reducedUpsamplePass.shader.reset();
+        }
+
+        m_finalPass.shader = KWin::ShaderManager::instance()->generateShaderFromFile(
+            KWin::ShaderTrait::MapTexture,
+            QStringLiteral(":/effects/blur/shaders/vertex.vert"),
+            QStringLiteral(":/effects/blur/shaders/final.frag")
+        );
+        if (!m_finalPass.shader) {
+            qCWarning(KWIN_BLUR) << "Failed to load final pass shader";
+            return false;
+        }
+        m_finalPass.mvpMatrixLocation = m_finalPass.shader->uniformLocation("modelViewProjectionMatrix");
+        m_finalPass.offsetLocation = m_finalPass.shader->uniformLocation("offset");
+        m_finalPass.halfpixelLocation = m_finalPass.shader->uniformLocation("halfpixel");
+        m_finalPass.textureScaleLocation = m_finalPass.shader->uniformLocation("textureScale");
+        m_finalPass.textureOffsetLocation = m_finalPass.shader->uniformLocation("textureOffset");
+        m_finalPass.textureBoundsLocation = m_finalPass.shader->uniformLocation("textureBounds");
+        m_finalPass.noiseStrengthLocation = m_finalPass.shader->uniformLocation("noiseStrength");
+        m_finalPass.noiseScaleLocation = m_finalPass.shader->uniformLocation("noiseScale");
+        m_finalPass.opacityLocation = m_finalPass.shader->uniformLocation("opacity");
+        m_finalPass.cornerRectLocation = m_finalPass.shader->uniformLocation("cornerRect");
+        m_finalPass.cornerRadiusLocation = m_finalPass.shader->uniformLocation("cornerRadius");
+        m_finalPass.cornerExponentLocation = m_finalPass.shader->uniformLocation("cornerExponent");
+        m_finalPass.maskUnitLocation = m_finalPass.shader->uniformLocation("maskUnit");
+        m_finalPass.maskRectLocation = m_finalPass.shader->uniformLocation("maskRect");
+        m_finalPass.maskEnabledLocation = m_finalPass.shader->uniformLocation("maskEnabled");
+
+        m_pyramidTimer = std::make_unique<GPUTimer>();
+
+        if (GPUTimer::supported()) {
+            // The pyramids are timed with their own timer, so they don't count for the quality governor
+            auto render = [this](StrengthCalibration::Choice const& choice, std::unique_ptr<GPUTimer>& timer) {
+                BlurKernel kernel;
+                kernel.iterationCount = choice.iteration;
+                kernel.offset = choice.offset;
+                m_calibrationBlur.rect = QRect(QPoint(0, 0), s_calibrationSize);
+                m_calibrationBlur.kernel = kernel;
+                if (!allocateRenderTargets(m_calibrationBlur.render, kernel, m_calibrationFormat, m_calibrationOutputFormat, s_calibrationSize)) {
+                    return false;
+                }
+                std::swap(m_pyramidTimer, timer);
+                bool const rendered = renderSharedPyramid(m_calibrationBlur, nullptr);
+                std::swap(m_pyramidTimer, timer);
+                return rendered;
+            };
+            auto finished = [this](QList<StrengthCalibration::Choice> const& choices) {
+                m_calibrationBlur.render = BlurRenderData();
+                if (m_calibration->pipeline() == m_calibrationPipeline) {
+                    applyCalibration(choices);
+                    reconfigure(ReconfigureAll);
+                }
+            };
+            m_calibration = std::make_unique<StrengthCalibration>(render, finished);
+        }
+        return true;
+    }
+
+    bool BlurEffect::loadSamplingPass(SamplingPass& pass, QString const& fragmentShader)
+    {
+        pass.shader = KWin::ShaderManager::instance()->generateShaderFromFile(
+            KWin::ShaderTrait::MapTexture,
+            QStringLiteral(":/effects/blur/shaders/vertex.vert"),
+            fragmentShader
+        );
+        if (!pass.shader) {
+            return false;
         }
+        pass.mvpMatrixLocation = pass.shader->uniformLocation("modelViewProjectionMatrix");
+        pass.offsetLocation = pass.shader->uniformLocation("offset");
+        pass.halfpixelLocation = pass.shader->uniformLocation("halfpixel");
+        pass.textureScaleLocation = pass.shader->uniformLocation("textureScale");
+        pass.textureOffsetLocation = pass.shader->uniformLocation("textureOffset");
+        pass.textureBoundsLocation = pass.shader->uniformLocation("textureBounds");
+        pass.tapSpreadLocation = pass.shader->uniformLocation("tapSpread");
+        return true;
     }
 
     void BlurEffect::reconfigure(ReconfigureFlags flags)
@@ -215,11 +537,50 @@ namespace Lightly {
         Q_UNUSED(flags)
         KWin::BlurConfig::self()->read();
 
-        int blurStrength = KWin::BlurConfig::blurStrength() - 1;
-        m_iterationCount = blurStrengthValues[blurStrength].iteration;
-        m_offset = blurStrengthValues[blurStrength].offset;
-        m_expandSize = blurOffsets[m_iterationCount - 1].expandSize;
+        m_blurStrength = std::clamp(KWin::BlurConfig::blurStrength(), 1, int(blurStrengthValues.size()));
+        m_governor.setEnabled(KWin::BlurConfig::adaptiveQuality());
+        m_governor.setMaximumLevel(blurStrengthValues[m_blurStrength - 1].iteration - 1);
+        applyQualityLevel();
+
+        // Window rules as "class=strength", the class is matched against both parts of the window class
+        m_classStrengths.clear();
+        for (QString const& rule : KWin::BlurConfig::windowStrengths()) {
+            bool ok = false;
+            QString const windowClass = rule.section(QLatin1Char('='), 0, 0).trimmed().toLower();
+            int const strength = rule.section(QLatin1Char('='), 1).trimmed().toInt(&ok);
+            if (windowClass.isEmpty() || !ok || strength < 1 || strength > blurStrengthValues.size()) {
+                qCWarning(KWIN_BLUR) << "Ignoring the blur strength rule" << rule;
+                continue;
+            }
+            m_classStrengths.insert(windowClass, strength);
+        }
+        for (auto const& [window, data] : m_windows) {
+            scheduleBlurRegionUpdate(window);
+        }
         m_noiseStrength = KWin::BlurConfig::noiseStrength();
+        m_blurTransformedWindows = KWin::BlurConfig::blurTransformedWindows();
+        m_reducedTaps = KWin::BlurConfig::reducedTaps() && m_reducedDownsamplePass.shader && m_reducedUpsamplePass.shader;
+        m_intermediateFormat = KWin::BlurConfig::intermediateFormat();
+        int const refreshRate = KWin::BlurConfig::blurRefreshRate();
+        m_refreshInterval = std::chrono::nanoseconds(refreshRate > 0 ? qint64(1e9 / refreshRate) : 0);
+        m_texturePool.setBudget(qint64(KWin::BlurConfig::texturePoolSize()) * 1024 * 1024);
+
+        if (m_cpuBlur) {
+            m_cpuBlur->setThreadCount(KWin::BlurConfig::softwareBlurThreads());
+            m_logicalResolutionBlur = KWin::BlurConfig::logicalResolutionBlur();
+        } else {
+            KWin::effects->makeOpenGLContextCurrent();
+            if (KWin::BlurConfig::useComputeShaders() && ComputeBlur::supported()) {
+                if (!m_computeBlur) {
+                    m_computeBlur = std::make_unique<ComputeBlur>();
+                }
+            } else {
+                m_computeBlur.reset();
+            }
+        }
+
+        loadCalibration();
+        discardCachedBlur(KWin::infiniteRegion());
 
         // Update all windows for the blur to take effect
         KWin::effects->addRepaintFull();
@@ -227,6 +588,35 @@ namespace Lightly {
         m_helper->reconfigure();
     }
 
+    static size_t regionHash(std::optional<QRegion> const& region, size_t seed)
+    {
+        if (!region.has_value()) {
+            return qHashMulti(seed, false);
+        }
+
+        seed = qHashMulti(seed, true, region->rectCount());
+        for (QRect const& rect : *region) {
+            seed = qHashMulti(seed, rect.x(), rect.y(), rect.width(), rect.height());
+        }
+        return seed;
+    }
+
+    void BlurEffect::scheduleBlurRegionUpdate(KWin::EffectWindow* window)
+    {
+        // Some clients change their blur region many times per frame, only the last state matters
+        ++m_statistics.regionUpdatesReceived;
+        m_pendingRegionUpdates.insert(window);
+    }
+
+    void BlurEffect::processBlurRegionUpdates()
+    {
+        for (KWin::EffectWindow* window : m_pendingRegionUpdates) {
+            ++m_statistics.regionUpdatesProcessed;
+            updateBlurRegion(window);
+        }
+        m_pendingRegionUpdates.clear();
+    }
+
     void BlurEffect::updateBlurRegion(KWin::EffectWindow* window)
     {
         std::optional<QRegion> content;
@@ -270,9 +660,18 @@ namespace Lightly {
         }
 
         if (content.has_value() || frame.has_value()) {
+            int const strength = windowStrength(window);
+            size_t const hash = qHashMulti(regionHash(frame, regionHash(content, 0)), strength);
+            if (auto it = m_windows.find(window); it != m_windows.end() && it->second.regionHash == hash) {
+                ++m_statistics.regionUpdatesDropped;
+                return;
+            }
+
             BlurEffectData& data = m_windows[window];
             data.content = content;
             data.frame = frame;
+            data.strength = strength;
+            data.regionHash = hash;
             data.windowEffect = KWin::ItemEffect(window->windowItem());
         } else {
             if (auto it = m_windows.find(window); it != m_windows.end()) {
@@ -282,12 +681,42 @@ namespace Lightly {
         }
     }
 
+    int BlurEffect::windowStrength(KWin::EffectWindow* window) const
+    {
+        // A hint of the client wins over the window rules
+#if KWIN_BUILD_X11
+        if (net_wm_blur_strength != XCB_ATOM_NONE) {
+            QByteArray const value = window->readProperty(net_wm_blur_strength, XCB_ATOM_CARDINAL, 32);
+            if (value.size() == sizeof(uint32_t)) {
+                return std::clamp(int(*reinterpret_cast<uint32_t const*>(value.constData())), 1, int(blurStrengthValues.size()));
+            }
+        }
+#endif
+
+        if (auto internal = window->internalWindow()) {
+            bool ok = false;
+            int const strength = internal->property("lightly_blur_strength").toInt(&ok);
+            if (ok && strength > 0) {
+                return std::min(strength, int(blurStrengthValues.size()));
+            }
+        }
+
+        if (!m_classStrengths.isEmpty()) {
+            for (QString const& name : window->windowClass().split(QLatin1Char(' '), Qt::SkipEmptyParts)) {
+                if (auto it = m_classStrengths.constFind(name.toLower()); it != m_classStrengths.constEnd()) {
+                    return *it;
+                }
+            }
+        }
+        return 0;
+    }
+
     void BlurEffect::slotWindowAdded(KWin::EffectWindow* w)
     {
         if (auto surface = w->surface()) {
             windowBlurChangedConnections[w] = connect(surface, &KWin::SurfaceInterface::blurChanged, this, [this, w]() {
                 if (w) {
-                    updateBlurRegion(w);
+                    scheduleBlurRegionUpdate(w);
                 }
             });
         }
@@ -298,7 +727,12 @@ namespace Lightly {
         connect(w, &KWin::EffectWindow::windowDecorationChanged, this, &BlurEffect::setupDecorationConnections);
         setupDecorationConnections(w);
 
-        updateBlurRegion(w);
+        if (w->isDesktop()) {
+            connect(w, &KWin::EffectWindow::windowDamaged, this, &BlurEffect::slotDesktopChanged);
+            connect(w, &KWin::EffectWindow::windowFrameGeometryChanged, this, &BlurEffect::slotDesktopChanged);
+        }
+
+        scheduleBlurRegionUpdate(w);
 
         // Check if window needs rounding corners
         m_helper->blurWindowAdded(w);
@@ -306,10 +740,19 @@ namespace Lightly {
 
     void BlurEffect::slotWindowDeleted(KWin::EffectWindow* w)
     {
+        slotWindowVisibilityChanged(w);
+
+        m_pendingRegionUpdates.erase(w);
+        m_sampledDesktops.erase(w);
+
         if (auto it = m_windows.find(w); it != m_windows.end()) {
             KWin::effects->makeOpenGLContextCurrent();
             m_windows.erase(it);
         }
+        if (auto it = m_desktopBlurs.find(w); it != m_desktopBlurs.end()) {
+            KWin::effects->makeOpenGLContextCurrent();
+            m_desktopBlurs.erase(it);
+        }
         if (auto it = windowBlurChangedConnections.find(w); it != windowBlurChangedConnections.end()) {
             disconnect(*it);
             windowBlurChangedConnections.erase(it);
@@ -327,13 +770,46 @@ namespace Lightly {
                 data.render.erase(it);
             }
         }
+        for (auto& [desktop, screens] : m_desktopBlurs) {
+            if (auto it = screens.find(screen); it != screens.end()) {
+                KWin::effects->makeOpenGLContextCurrent();
+                screens.erase(it);
+            }
+        }
+        m_screenFrames.erase(screen);
+    }
+
+    void BlurEffect::slotWindowVisibilityChanged(KWin::EffectWindow* w)
+    {
+        discardCachedBlur(w->expandedGeometry().toAlignedRect());
+    }
+
+    void BlurEffect::slotDesktopChanged(KWin::EffectWindow* w)
+    {
+        if (auto it = m_desktopBlurs.find(w); it != m_desktopBlurs.end()) {
+            for (auto& [screen, desktopBlur] : it->second) {
+                desktopBlur.valid = false;
+                desktopBlur.damaged.start();
+            }
+        }
+    }
+
+    void BlurEffect::discardCachedBlur(QRegion const& area)
+    {
+        for (auto& [window, data] : m_windows) {
+            for (auto& [screen, renderInfo] : data.render) {
+                if (area.intersects(renderInfo.blurRect)) {
+                    renderInfo.blurValid = false;
+                }
+            }
+        }
     }
 
 #if KWIN_BUILD_X11
     void BlurEffect::slotPropertyNotify(KWin::EffectWindow* w, long atom)
     {
-        if (w && atom == net_wm_blur_region && net_wm_blur_region != XCB_ATOM_NONE) {
-            updateBlurRegion(w);
+        if (w && (atom == net_wm_blur_region || atom == net_wm_blur_strength) && atom != XCB_ATOM_NONE) {
+            scheduleBlurRegionUpdate(w);
         }
     }
 #endif
@@ -345,7 +821,7 @@ namespace Lightly {
         }
 
         connect(w->decoration(), &KDecoration2::Decoration::blurRegionChanged, this, [this, w]() {
-            updateBlurRegion(w);
+            scheduleBlurRegionUpdate(w);
         });
     }
 
@@ -354,9 +830,9 @@ namespace Lightly {
         auto internal = qobject_cast<QWindow*>(watched);
         if (internal && event->type() == QEvent::DynamicPropertyChange) {
             QDynamicPropertyChangeEvent* pe = static_cast<QDynamicPropertyChangeEvent*>(event);
-            if (pe->propertyName() == "kwin_blur") {
+            if (pe->propertyName() == "kwin_blur" || pe->propertyName() == "lightly_blur_strength") {
                 if (auto w = KWin::effects->findWindow(internal)) {
-                    updateBlurRegion(w);
+                    scheduleBlurRegionUpdate(w);
                 }
             }
         }
@@ -370,6 +846,9 @@ namespace Lightly {
 
     bool BlurEffect::supported()
     {
+        if (KWin::effects->compositingType() == KWin::QPainterCompositing) {
+            return true;
+        }
         return KWin::effects->openglContext() && (KWin::effects->openglContext()->supportsBlits() || KWin::effects->waylandDisplay());
     }
 
@@ -410,9 +889,6 @@ namespace Lightly {
             } else if (frame.has_value()) {
                 region = frame.value();
             }
-
-            // Apply LighlyShaders to blur region
-            m_helper->roundBlurRegion(window, &region);
         }
 
         return region;
@@ -420,9 +896,44 @@ namespace Lightly {
 
     void BlurEffect::prePaintScreen(KWin::ScreenPrePaintData& data, std::chrono::milliseconds presentTime)
     {
-        m_paintedArea = QRegion();
-        m_currentBlur = QRegion();
+        QElapsedTimer cpuTimer;
+        cpuTimer.start();
+
+        processBlurRegionUpdates();
+
         m_currentScreen = KWin::effects->waylandDisplay() ? data.screen : nullptr;
+        m_currentFrame = ++m_screenFrames[m_currentScreen];
+        m_presentTime = presentTime;
+
+        // Let the governor see the blur passes timed since the last frame against the refresh interval
+        uint refreshRate = m_currentScreen ? m_currentScreen->refreshRate() : 0;
+        if (!m_currentScreen) {
+            for (KWin::Output* output : KWin::effects->screens()) {
+                refreshRate = std::max<uint>(refreshRate, output->refreshRate());
+            }
+        }
+        int const level = m_governor.level();
+        m_governor.update(m_frameBlurTime, refreshRate ? std::chrono::nanoseconds(1'000'000'000'000ll / refreshRate) : std::chrono::nanoseconds(0));
+        m_frameBlurTime = {};
+        if (m_governor.level() != level) {
+            applyQualityLevel();
+        }
+
+        m_screenArea = m_currentScreen ? m_currentScreen->geometry() : KWin::effects->virtualScreenGeometry();
+        m_paintedArea.reset(m_screenArea);
+        m_currentBlur.reset(m_screenArea);
+        m_blurMargins.clear();
+        m_sharedBlurCover.reset(m_screenArea);
+        m_sharedBlurs.clear();
+        m_desktopCover.reset(m_screenArea);
+        m_desktopAreas.clear();
+        m_sampledDesktops.clear();
+        ++m_statistics.frames;
+
+        releaseIdleRenderTargets();
+        m_texturePool.trim();
+
+        m_statistics.prePaintTime += std::chrono::nanoseconds(cpuTimer.nsecsElapsed());
 
         KWin::effects->prePaintScreen(data, presentTime);
     }
@@ -433,27 +944,110 @@ namespace Lightly {
 
         KWin::effects->prePaintWindow(w, data, presentTime);
 
+        QElapsedTimer cpuTimer;
+        cpuTimer.start();
+        ++m_statistics.prePaintWindows;
+
+        // The painted and blurred areas are tracked as tile masks. They only ever err on the larger
+        // side, so the paint region can grow by a few tiles compared to exact regions but never shrinks.
         QRegion const oldOpaque = data.opaque;
-        if (data.opaque.intersects(m_currentBlur)) {
-            // to blur an area partially we have to shrink the opaque area of a window
+        if (m_currentBlur.intersects(data.opaque)) {
+            // to blur an area partially we have to shrink the opaque area of a window,
+            // by as much as the kernels of the blurred areas under it reach
             QRegion newOpaque;
             for (QRect const& rect : data.opaque) {
-                newOpaque += rect.adjusted(m_expandSize, m_expandSize, -m_expandSize, -m_expandSize);
+                int margin = 0;
+                for (auto const& [area, expandSize] : m_blurMargins) {
+                    if (expandSize > margin && area.adjusted(-expandSize, -expandSize, expandSize, expandSize).intersects(rect)) {
+                        margin = expandSize;
+                    }
+                }
+                newOpaque += rect.adjusted(margin, margin, -margin, -margin);
             }
             data.opaque = newOpaque;
 
             // we don't have to blur a region we don't see
-            m_currentBlur -= newOpaque;
+            m_currentBlur.subtractCovered(newOpaque);
         }
 
         // if we have to paint a non-opaque part of this window that intersects with the
         // currently blurred region we have to redraw the whole region
-        if ((data.paint - oldOpaque).intersects(m_currentBlur)) {
-            data.paint += m_currentBlur;
+        if (m_currentBlur.intersects(data.paint - oldOpaque)) {
+            data.paint += m_currentBlur.toRegion();
         }
 
         // in case this window has regions to be blurred
         QRegion const blurArea = blurRegion(w).boundingRect().translated(w->pos().toPoint());
+        int expandSize = 0;
+
+        // remember what has been repainted behind the window, its cached blur is stale there
+        if (auto it = m_windows.find(w); it != m_windows.end()) {
+            BlurRenderData& renderInfo = it->second.render[m_currentScreen];
+            if (renderInfo.lastPrePaintFrame + 1 != m_currentFrame) {
+                // we don't know what happened behind the window while it wasn't painted
+                renderInfo.blurValid = false;
+            }
+            renderInfo.lastPrePaintFrame = m_currentFrame;
+            if (!blurArea.isEmpty()) {
+                renderInfo.backdropDamage += m_paintedArea.toRegion(blurArea.boundingRect());
+            }
+
+            // A window joins the current shared blur if nothing painted since the shared blur started
+            // reaches into its backdrop, including what the blur samples around it.
+            it->second.sharedBlur = -1;
+            it->second.desktop = nullptr;
+            if (!blurArea.isEmpty()) {
+                QRect const blurRect = blurArea.boundingRect();
+                BlurKernel const kernel = kernelFor(it->second);
+                expandSize = kernel.expandSize;
+                QRect const sampledRect = blurRect.adjusted(-expandSize, -expandSize, expandSize, expandSize);
+
+                // Nothing painted above a desktop reaches into the backdrop, the blurred desktop can be sampled
+                if (!m_desktopCover.intersects(sampledRect)) {
+                    for (auto const& [desktop, area] : m_desktopAreas) {
+                        if (area.contains(blurRect)) {
+                            it->second.desktop = desktop;
+                        }
+                    }
+                    // The desktop is blurred with the configured strength when it's drawn
+                    if (it->second.desktop && kernel == m_kernel) {
+                        m_sampledDesktops.insert(it->second.desktop);
+                    }
+                }
+
+                // Only windows blurred with the same kernel can share it
+                if (m_sharedBlurs.empty() || m_sharedBlurs.back().kernel != kernel || m_sharedBlurCover.intersects(sampledRect)) {
+                    m_sharedBlurs.emplace_back().kernel = kernel;
+                    m_sharedBlurCover.clear();
+                }
+
+                qint64 separateCost = 0;
+                if (!renderInfo.blurValid || renderInfo.blurRect != blurRect) {
+                    separateCost = qint64(blurRect.width()) * blurRect.height();
+                } else if (!renderInfo.backdropDamage.isEmpty()) {
+                    QRect const damage = renderInfo.backdropDamage.boundingRect().adjusted(-expandSize, -expandSize, expandSize, expandSize) & blurRect;
+                    separateCost = qint64(damage.width()) * damage.height();
+                }
+
+                SharedBlur& shared = m_sharedBlurs.back();
+                shared.rect |= blurRect;
+                shared.separateCost += separateCost;
+                ++shared.members;
+                it->second.sharedBlur = m_sharedBlurs.size() - 1;
+
+                // A transformed window without a blur to keep captures its untransformed backdrop once,
+                // which has to be painted in this frame
+                if (m_blurTransformedWindows && (data.mask & PAINT_WINDOW_TRANSFORMED) && renderInfo.blurRect != blurRect) {
+                    data.paint += blurArea;
+                }
+            }
+        }
+        m_sharedBlurCover.add(w->expandedGeometry().toAlignedRect());
+        if (!w->isDesktop()) {
+            m_desktopCover.add(w->expandedGeometry().toAlignedRect());
+        } else if (!(data.mask & PAINT_WINDOW_TRANSFORMED) && w->opacity() >= 1.0) {
+            m_desktopAreas.emplace_back(w, w->frameGeometry().toAlignedRect() & m_screenArea);
+        }
 
         // if this window or a window underneath the blurred area is painted again we have to
         // blur everything
@@ -461,15 +1055,41 @@ namespace Lightly {
             data.paint += blurArea;
             // we have to check again whether we do not damage a blurred area
             // of a window
-            if (blurArea.intersects(m_currentBlur)) {
-                data.paint += m_currentBlur;
+            if (m_currentBlur.intersects(blurArea)) {
+                data.paint += m_currentBlur.toRegion();
             }
         }
 
-        m_currentBlur += blurArea;
+        m_currentBlur.add(blurArea);
+        if (!blurArea.isEmpty()) {
+            m_blurMargins.emplace_back(blurArea.boundingRect(), expandSize);
+        }
+
+        m_paintedArea.subtractCovered(data.opaque);
+        m_paintedArea.add(data.paint);
+
+        m_statistics.prePaintTime += std::chrono::nanoseconds(cpuTimer.nsecsElapsed());
+    }
+
+    void BlurEffect::deferBlur(QRect const& area, std::chrono::nanoseconds due)
+    {
+        // The backdrops held back by the refresh cap are painted again once, when the earliest of them
+        // may be blurred, in case nothing else damages them in the meantime. Those still held back then
+        // schedule the next repaint.
+        std::chrono::nanoseconds const delay = std::max(due - m_presentTime, std::chrono::nanoseconds(0));
+        std::chrono::milliseconds const interval = std::chrono::ceil<std::chrono::milliseconds>(delay);
+        if (!m_deferredBlurTimer.isActive() || interval < m_deferredBlurTimer.remainingTimeAsDuration()) {
+            m_deferredBlurTimer.start(interval);
+        }
+        m_deferredBlurArea += area;
+    }
+
+    static bool isTransformed(int mask, KWin::WindowPaintData const& data)
+    {
+        bool scaled = !qFuzzyCompare(data.xScale(), 1.0) && !qFuzzyCompare(data.yScale(), 1.0);
+        bool translated = data.xTranslation() || data.yTranslation();
 
-        m_paintedArea -= data.opaque;
-        m_paintedArea += data.paint;
+        return scaled || translated || (mask & KWin::Effect::PAINT_WINDOW_TRANSFORMED);
     }
 
     bool BlurEffect::shouldBlur(KWin::EffectWindow const* window, int mask, KWin::WindowPaintData const& data) const
@@ -482,10 +1102,8 @@ namespace Lightly {
             return false;
         }
 
-        bool scaled = !qFuzzyCompare(data.xScale(), 1.0) && !qFuzzyCompare(data.yScale(), 1.0);
-        bool translated = data.xTranslation() || data.yTranslation();
-
-        if ((scaled || (translated || (mask & PAINT_WINDOW_TRANSFORMED))) && !window->data(KWin::WindowForceBlurRole).toBool()) {
+        // Transformed windows either draw the blur cached before the transformation or lose it
+        if (isTransformed(mask, data) && !m_blurTransformedWindows && !window->data(KWin::WindowForceBlurRole).toBool()) {
             return false;
         }
 
@@ -494,351 +1112,1012 @@ namespace Lightly {
 
     void BlurEffect::drawWindow(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, KWin::EffectWindow* w, int mask, QRegion const& region, KWin::WindowPaintData& data)
     {
+        QElapsedTimer cpuTimer;
+        cpuTimer.start();
+        // A desktop is drawn before the windows above it that sample its blur, it's drawn once more
+        // on its own down the effect chain when its kept blur is outdated
+        if (m_sampledDesktops.contains(w)) {
+            updateDesktopBlur(renderTarget, w);
+        }
         blur(renderTarget, viewport, w, mask, region, data);
+        m_statistics.cpuTime += std::chrono::nanoseconds(cpuTimer.nsecsElapsed());
 
         // Draw the window over the blurred area
         KWin::effects->drawWindow(renderTarget, viewport, w, mask, region, data);
     }
 
-    KWin::GLTexture* BlurEffect::ensureNoiseTexture()
+    static QRegion grownRegion(QRegion const& region, int margin, QRect const& bounds)
     {
-        if (m_noiseStrength == 0) {
-            return nullptr;
+        QRegion grown;
+        for (QRect const& rect : region) {
+            grown += rect.adjusted(-margin, -margin, margin, margin);
         }
+        // Scissoring many small rects costs more than it saves
+        if (grown.rectCount() > 8) {
+            grown = grown.boundingRect();
+        }
+        return grown & bounds;
+    }
 
-        qreal const scale = std::max(1.0, QGuiApplication::primaryScreen()->logicalDotsPerInch() / 96.0);
-        if (!m_noisePass.noiseTexture || m_noisePass.noiseTextureScale != scale || m_noisePass.noiseTextureStength != m_noiseStrength) {
-            // Init randomness based on time
-            std::srand(static_cast<uint>(QTime::currentTime().msec()));
-
-            QImage noiseImage(QSize(256, 256), QImage::Format_Grayscale8);
-
-            for (int y = 0; y < noiseImage.height(); y++) {
-                uint8_t* noiseImageLine = (uint8_t*)noiseImage.scanLine(y);
+    static void drawOffscreenQuad(KWin::GLVertexBuffer* vbo, QSize const& framebufferSize, QSize const& logicalSize, QRegion const* damage)
+    {
+        if (!damage) {
+            vbo->draw(GL_TRIANGLES, 0, 6);
+            return;
+        }
 
-                for (int x = 0; x < noiseImage.width(); x++) {
-                    noiseImageLine[x] = std::rand() % m_noiseStrength;
-                }
-            }
+        // The damage is in logical pixels with the origin at the top left corner, the framebuffer
+        // is scaled down and its origin is at the bottom left corner.
+        qreal const xScale = qreal(framebufferSize.width()) / logicalSize.width();
+        qreal const yScale = qreal(framebufferSize.height()) / logicalSize.height();
 
-            noiseImage = noiseImage.scaled(noiseImage.size() * scale);
+        glEnable(GL_SCISSOR_TEST);
+        for (QRect const& rect : *damage) {
+            int const x0 = std::floor(rect.x() * xScale);
+            int const y0 = std::floor(rect.y() * yScale);
+            int const x1 = std::ceil((rect.x() + rect.width()) * xScale);
+            int const y1 = std::ceil((rect.y() + rect.height()) * yScale);
 
-            m_noisePass.noiseTexture = KWin::GLTexture::upload(noiseImage);
-            if (!m_noisePass.noiseTexture) {
-                return nullptr;
-            }
-            m_noisePass.noiseTexture->setFilter(GL_NEAREST);
-            m_noisePass.noiseTexture->setWrapMode(GL_REPEAT);
-            m_noisePass.noiseTextureScale = scale;
-            m_noisePass.noiseTextureStength = m_noiseStrength;
+            glScissor(x0, framebufferSize.height() - y1, x1 - x0, y1 - y0);
+            vbo->draw(GL_TRIANGLES, 0, 6);
         }
-
-        return m_noisePass.noiseTexture.get();
+        glDisable(GL_SCISSOR_TEST);
     }
 
-    void BlurEffect::blur(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, KWin::EffectWindow* w, int mask, QRegion const& region, KWin::WindowPaintData& data)
+    // Blur shapes with more rects than this are drawn through a mask texture instead of a quad per rect.
+    // In maskpathtest the mask gets cheaper between 80 and 96 rects, the mask also has to be rebuilt
+    // when the shape changes, so the threshold is at the upper end.
+    static constexpr int s_maskRectCount = 96;
+
+    // Two triangles covering the rect, the texture coordinates map textureRect to the whole texture
+    static void appendQuad(std::span<KWin::GLVertex2D> map, size_t& index, QRectF const& rect, QRectF const& textureRect)
     {
-        auto it = m_windows.find(w);
-        if (it == m_windows.end()) {
+        float const x0 = rect.left();
+        float const y0 = rect.top();
+        float const x1 = rect.right();
+        float const y1 = rect.bottom();
+
+        float const u0 = (x0 - textureRect.x()) / textureRect.width();
+        float const v0 = 1.0f - (y0 - textureRect.y()) / textureRect.height();
+        float const u1 = (x1 - textureRect.x()) / textureRect.width();
+        float const v1 = 1.0f - (y1 - textureRect.y()) / textureRect.height();
+
+        // first triangle
+        map[index++] = KWin::GLVertex2D {
+            .position = QVector2D(x0, y0),
+            .texcoord = QVector2D(u0, v0),
+        };
+        map[index++] = KWin::GLVertex2D {
+            .position = QVector2D(x1, y1),
+            .texcoord = QVector2D(u1, v1),
+        };
+        map[index++] = KWin::GLVertex2D {
+            .position = QVector2D(x0, y1),
+            .texcoord = QVector2D(u0, v1),
+        };
+
+        // second triangle
+        map[index++] = KWin::GLVertex2D {
+            .position = QVector2D(x0, y0),
+            .texcoord = QVector2D(u0, v0),
+        };
+        map[index++] = KWin::GLVertex2D {
+            .position = QVector2D(x1, y0),
+            .texcoord = QVector2D(u1, v0),
+        };
+        map[index++] = KWin::GLVertex2D {
+            .position = QVector2D(x1, y1),
+            .texcoord = QVector2D(u1, v1),
+        };
+    }
+
+    void BlurEffect::renderPyramid(KWin::GLVertexBuffer* vbo, BlurRenderData& renderInfo, BlurKernel const& kernel, QSize const& logicalSize, std::vector<QRegion> const* downsampleDamage, std::vector<QRegion> const* upsampleDamage, BackdropView const* backdrop)
+    {
+        // The first 6 vertices of the bound vertex buffer cover the background in logical pixels.
+        // If a backdrop view is given, the first downsample pass reads it instead of the first render target.
+        m_pyramidTimer->begin();
+
+        if (!backdrop && m_computeBlur && renderPyramidCompute(renderInfo, kernel, logicalSize, downsampleDamage, upsampleDamage)) {
+            m_pyramidTimer->end();
             return;
         }
 
-        BlurEffectData& blurInfo = it->second;
-        BlurRenderData& renderInfo = blurInfo.render[m_currentScreen];
-        if (!shouldBlur(w, mask, data)) {
-            return;
+        SamplingPass const& downsamplePass = m_reducedTaps ? m_reducedDownsamplePass : m_downsamplePass;
+        SamplingPass const& upsamplePass = m_reducedTaps ? m_reducedUpsamplePass : m_upsamplePass;
+
+        QMatrix4x4 projectionMatrix;
+        projectionMatrix.ortho(QRectF(0.0, 0.0, logicalSize.width(), logicalSize.height()));
+
+        // The downsample pass of the dual Kawase algorithm: the background will be scaled down 50% every iteration.
+        {
+            KWin::ShaderManager::instance()->pushShader(downsamplePass.shader.get());
+
+            downsamplePass.shader->setUniform(downsamplePass.mvpMatrixLocation, projectionMatrix);
+            downsamplePass.shader->setUniform(downsamplePass.offsetLocation, float(kernel.offset));
+            downsamplePass.shader->setUniform(downsamplePass.tapSpreadLocation, reducedTapSpread(s_downsampleTapVariance));
+
+            // The filter of the backdrop texture belongs to whoever owns it, it's set back after the first pass
+            GLenum backdropFilter = GL_LINEAR;
+
+            for (size_t i = 1; i < renderInfo.renderTargets.size(); ++i) {
+                TextureLease const& read = renderInfo.renderTargets[i - 1];
+                TextureLease const& draw = renderInfo.renderTargets[i];
+
+                if (i == 1 && backdrop) {
+                    downsamplePass.shader->setUniform(downsamplePass.halfpixelLocation, backdrop->halfpixel);
+                    downsamplePass.shader->setUniform(downsamplePass.textureScaleLocation, backdrop->textureScale);
+                    downsamplePass.shader->setUniform(downsamplePass.textureOffsetLocation, backdrop->textureOffset);
+                    downsamplePass.shader->setUniform(downsamplePass.textureBoundsLocation, backdrop->textureBounds);
+
+                    // The kernel relies on bilinear filtering, the output texture may be set to nearest
+                    backdropFilter = backdrop->texture->filter();
+                    backdrop->texture->setFilter(GL_LINEAR);
+                    backdrop->texture->bind();
+                } else {
+                    QVector2D const halfpixel(0.5 / read.texture()->width(), 0.5 / read.texture()->height());
+                    downsamplePass.shader->setUniform(downsamplePass.halfpixelLocation, halfpixel);
+                    downsamplePass.shader->setUniform(downsamplePass.textureScaleLocation, read.textureScale());
+                    downsamplePass.shader->setUniform(downsamplePass.textureOffsetLocation, QVector2D());
+                    downsamplePass.shader->setUniform(downsamplePass.textureBoundsLocation, read.textureBounds());
+
+                    read.texture()->bind();
+                }
+
+                KWin::GLFramebuffer::pushFramebuffer(draw.framebuffer());
+                glViewport(0, 0, draw.size().width(), draw.size().height());
+                drawOffscreenQuad(vbo, draw.size(), logicalSize, downsampleDamage ? &(*downsampleDamage)[i] : nullptr);
+                KWin::GLFramebuffer::popFramebuffer();
+
+                if (i == 1 && backdrop) {
+                    backdrop->texture->setFilter(backdropFilter);
+                }
+            }
+
+            KWin::ShaderManager::instance()->popShader();
         }
 
-        // Compute the effective blur shape. Note that if the window is transformed, so will be the blur shape.
-        QRegion blurShape = blurRegion(w).translated(w->pos().toPoint());
-        if (data.xScale() != 1 || data.yScale() != 1) {
-            QPoint pt = blurShape.boundingRect().topLeft();
-            QRegion scaledShape;
-            for (QRect const& r : blurShape) {
-                QPointF const topLeft(pt.x() + (r.x() - pt.x()) * data.xScale() + data.xTranslation(), pt.y() + (r.y() - pt.y()) * data.yScale() + data.yTranslation());
-                QPoint const bottomRight(std::floor(topLeft.x() + r.width() * data.xScale()) - 1, std::floor(topLeft.y() + r.height() * data.yScale()) - 1);
-                scaledShape += QRect(QPoint(std::floor(topLeft.x()), std::floor(topLeft.y())), bottomRight);
-            }
-            blurShape = scaledShape;
-        } else if (data.xTranslation() || data.yTranslation()) {
-            blurShape.translate(std::round(data.xTranslation()), std::round(data.yTranslation()));
+        // The upsample pass of the dual Kawase algorithm: the background will be scaled up 200% every iteration.
+        // The upsampled levels are kept apart from the downsampled ones, so both stay valid for partial updates.
+        {
+            KWin::ShaderManager::instance()->pushShader(upsamplePass.shader.get());
+
+            upsamplePass.shader->setUniform(upsamplePass.mvpMatrixLocation, projectionMatrix);
+            upsamplePass.shader->setUniform(upsamplePass.offsetLocation, float(kernel.offset));
+            upsamplePass.shader->setUniform(upsamplePass.tapSpreadLocation, reducedTapSpread(s_upsampleTapVariance));
+
+            for (size_t i = kernel.iterationCount - 1; i >= 1; --i) {
+                TextureLease const& read = (i + 1 == kernel.iterationCount) ? renderInfo.renderTargets[i + 1] : renderInfo.upsampleRenderTargets[i];
+                TextureLease const& draw = renderInfo.upsampleRenderTargets[i - 1];
+
+                QVector2D const halfpixel(0.5 / read.texture()->width(), 0.5 / read.texture()->height());
+                upsamplePass.shader->setUniform(upsamplePass.halfpixelLocation, halfpixel);
+                upsamplePass.shader->setUniform(upsamplePass.textureScaleLocation, read.textureScale());
+                upsamplePass.shader->setUniform(upsamplePass.textureBoundsLocation, read.textureBounds());
+
+                read.texture()->bind();
+
+                KWin::GLFramebuffer::pushFramebuffer(draw.framebuffer());
+                glViewport(0, 0, draw.size().width(), draw.size().height());
+                drawOffscreenQuad(vbo, draw.size(), logicalSize, upsampleDamage ? &(*upsampleDamage)[i] : nullptr);
+                KWin::GLFramebuffer::popFramebuffer();
+            }
+
+            KWin::ShaderManager::instance()->popShader();
         }
 
-        QRect const backgroundRect = blurShape.boundingRect();
-        QRect const deviceBackgroundRect = KWin::snapToPixelGrid(KWin::scaledRect(backgroundRect, viewport.scale()));
-        auto const opacity = w->opacity() * data.opacity();
+        m_pyramidTimer->end();
+    }
 
-        // Get the effective shape that will be actually blurred. It's possible that all of it will be clipped.
-        QList<QRectF> effectiveShape;
-        effectiveShape.reserve(blurShape.rectCount());
-        if (region != KWin::infiniteRegion()) {
-            for (QRect const& clipRect : region) {
-                QRectF const deviceClipRect = KWin::snapToPixelGridF(KWin::scaledRect(clipRect, viewport.scale()))
-                                                  .translated(-deviceBackgroundRect.topLeft());
-                for (QRect const& shapeRect : blurShape) {
-                    QRectF const deviceShapeRect = KWin::snapToPixelGridF(KWin::scaledRect(shapeRect.translated(-backgroundRect.topLeft()), viewport.scale()));
-                    if (QRectF const intersected = deviceClipRect.intersected(deviceShapeRect); !intersected.isEmpty()) {
-                        effectiveShape.append(intersected);
-                    }
-                }
+    // The bounds of the damage on a level, in texels with the origin at the bottom left corner
+    static QRect levelArea(QSize const& levelSize, QSize const& logicalSize, QRegion const* damage)
+    {
+        QRect const level(QPoint(0, 0), levelSize);
+        if (!damage) {
+            return level;
+        }
+
+        QRect const bounds = damage->boundingRect();
+        qreal const xScale = qreal(levelSize.width()) / logicalSize.width();
+        qreal const yScale = qreal(levelSize.height()) / logicalSize.height();
+
+        int const x0 = std::floor(bounds.x() * xScale);
+        int const y0 = std::floor(bounds.y() * yScale);
+        int const x1 = std::ceil((bounds.x() + bounds.width()) * xScale);
+        int const y1 = std::ceil((bounds.y() + bounds.height()) * yScale);
+        return QRect(x0, levelSize.height() - y1, x1 - x0, y1 - y0) & level;
+    }
+
+    bool BlurEffect::renderPyramidCompute(BlurRenderData& renderInfo, BlurKernel const& kernel, QSize const& logicalSize, std::vector<QRegion> const* downsampleDamage, std::vector<QRegion> const* upsampleDamage)
+    {
+        // Falls back to the fragment shaders if the format can't be written from a compute shader.
+        // Damaged areas are rendered as their bounding rect, scissoring single rects doesn't apply here.
+        for (size_t i = 1; i < renderInfo.renderTargets.size(); ++i) {
+            TextureLease const& read = renderInfo.renderTargets[i - 1];
+            TextureLease const& draw = renderInfo.renderTargets[i];
+
+            QRect const area = levelArea(draw.size(), logicalSize, downsampleDamage ? &(*downsampleDamage)[i] : nullptr);
+            if (!m_computeBlur->dispatch(ComputeBlur::Pass::Downsample, read, draw, area, float(kernel.offset))) {
+                return false;
             }
-        } else {
-            for (QRect const& rect : blurShape) {
-                effectiveShape.append(KWin::snapToPixelGridF(KWin::scaledRect(rect.translated(-backgroundRect.topLeft()), viewport.scale())));
+        }
+
+        for (size_t i = kernel.iterationCount - 1; i >= 1; --i) {
+            TextureLease const& read = (i + 1 == kernel.iterationCount) ? renderInfo.renderTargets[i + 1] : renderInfo.upsampleRenderTargets[i];
+            TextureLease const& draw = renderInfo.upsampleRenderTargets[i - 1];
+
+            QRect const area = levelArea(draw.size(), logicalSize, upsampleDamage ? &(*upsampleDamage)[i] : nullptr);
+            if (!m_computeBlur->dispatch(ComputeBlur::Pass::Upsample, read, draw, area, float(kernel.offset))) {
+                return false;
             }
         }
-        if (effectiveShape.isEmpty()) {
+
+        return true;
+    }
+
+    bool BlurEffect::backdropView(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, QRect const& rect, BackdropView* view) const
+    {
+        // The compute shaders only read the first level, and the texture coordinates below
+        // don't account for rotated or flipped outputs
+        KWin::GLTexture* texture = renderTarget.texture();
+        if (!texture || m_computeBlur || renderTarget.transform().kind() != KWin::OutputTransform::Normal) {
+            return false;
+        }
+
+        QRect const deviceRect = viewport.mapToRenderTarget(rect);
+        QSize const textureSize = texture->size();
+        if (deviceRect.isEmpty() || !QRect(QPoint(0, 0), textureSize).contains(deviceRect)) {
+            return false;
+        }
+
+        // The texture has its origin at the bottom left corner
+        float const width = textureSize.width();
+        float const height = textureSize.height();
+        float const left = deviceRect.x();
+        float const bottom = textureSize.height() - (deviceRect.y() + deviceRect.height());
+
+        view->texture = texture;
+        view->textureScale = QVector2D(deviceRect.width() / width, deviceRect.height() / height);
+        view->textureOffset = QVector2D(left / width, bottom / height);
+        view->textureBounds = QVector4D((left + 0.5f) / width, (bottom + 0.5f) / height,
+                                        (left + deviceRect.width() - 0.5f) / width, (bottom + deviceRect.height() - 0.5f) / height);
+        // The kernel is spread over logical pixels, as it is when the backdrop is copied
+        view->halfpixel = QVector2D(0.5f * deviceRect.width() / rect.width() / width, 0.5f * deviceRect.height() / rect.height() / height);
+        return true;
+    }
+
+    // The output scale from which the CPU blur works in logical pixels
+    static constexpr qreal s_logicalResolutionScale = 1.5;
+
+    void BlurEffect::blurSoftware(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, BlurKernel const& kernel, QRegion const& blurShape, LSHelper::CornerShape const* corners, qreal opacity, QRegion const& paintRegion)
+    {
+        // The backdrop is read from the image in device pixels and painted back in logical coordinates,
+        // which doesn't account for rotated or flipped outputs
+        QImage* image = renderTarget.image();
+        QPainter* painter = KWin::effects->scenePainter();
+        if (!image || !painter || renderTarget.transform().kind() != KWin::OutputTransform::Normal) {
             return;
         }
 
-        // Maybe reallocate offscreen render targets. Keep in mind that the first one contains
-        // original background behind the window, it's not blurred.
-        GLenum textureFormat = GL_RGBA8;
-        if (renderTarget.texture()) {
-            textureFormat = renderTarget.texture()->internalFormat();
+        QRect const deviceRect = viewport.mapToRenderTarget(blurShape.boundingRect()) & image->rect();
+        if (deviceRect.isEmpty()) {
+            return;
         }
 
-        if (renderInfo.framebuffers.size() != (m_iterationCount + 1) || renderInfo.textures[0]->size() != backgroundRect.size() || renderInfo.textures[0]->internalFormat() != textureFormat) {
-            renderInfo.framebuffers.clear();
-            renderInfo.textures.clear();
+        QElapsedTimer timer;
+        timer.start();
+
+        // On scaled outputs the backdrop is blurred in logical pixels, as the GPU passes do, for a fraction
+        // of the pixels. Otherwise the offset is spread over device pixels so that the radius stays the same.
+        bool const logical = m_logicalResolutionBlur && viewport.scale() >= s_logicalResolutionScale;
+        qreal const ratio = logical ? 1.0 / viewport.scale() : 1.0; // pixels of the blur per device pixel
+        QSize const size(std::max(1, int(std::round(deviceRect.width() * ratio))), std::max(1, int(std::round(deviceRect.height() * ratio))));
+        m_cpuBlur->blur(*image, deviceRect, size, kernel.iterationCount, kernel.offset * viewport.scale() * ratio);
+
+        // The noise and the corners are placed in pixels of the blur, the noise keeps its size on the screen
+        qreal const noiseScale = std::max(1.0, QGuiApplication::primaryScreen()->logicalDotsPerInch() / 96.0);
+        m_cpuBlur->addNoise(m_noiseStrength, noiseScale * ratio, (QPointF(deviceRect.topLeft()) * ratio).toPoint());
+        if (corners) {
+            QRectF const deviceFrame = viewport.mapToRenderTarget(corners->frame).translated(-deviceRect.topLeft());
+            QRectF const frame(deviceFrame.topLeft() * ratio, deviceFrame.size() * ratio);
+            qreal const radius = std::min({corners->radius * viewport.scale() * ratio, frame.width() / 2, frame.height() / 2});
+            m_cpuBlur->clipCorners(frame, radius, corners->squircleRatio);
+        }
 
-            for (size_t i = 0; i <= m_iterationCount; ++i) {
-                auto texture = KWin::GLTexture::allocate(textureFormat, backgroundRect.size() / (1 << i));
-                if (!texture) {
-                    qCWarning(KWIN_BLUR) << "Failed to allocate an offscreen texture";
-                    return;
-                }
-                texture->setFilter(GL_LINEAR);
-                texture->setWrapMode(GL_CLAMP_TO_EDGE);
+        // The same opacity curve as in the final pass
+        qreal o = 1.0;
+        if (opacity < 1.0) {
+            o = 1.0 - (1.0 - opacity) * (1.0 - opacity);
+        }
 
-                auto framebuffer = std::make_unique<KWin::GLFramebuffer>(texture.get());
-                if (!framebuffer->valid()) {
-                    qCWarning(KWIN_BLUR) << "Failed to create an offscreen framebuffer";
-                    return;
-                }
-                renderInfo.textures.push_back(std::move(texture));
-                renderInfo.framebuffers.push_back(std::move(framebuffer));
+        QRectF const target(viewport.renderRect().topLeft() + QPointF(deviceRect.topLeft()) / viewport.scale(), QSizeF(deviceRect.size()) / viewport.scale());
+        painter->save();
+        painter->setClipRegion(paintRegion, Qt::IntersectClip);
+        painter->setOpacity(o);
+        painter->setRenderHint(QPainter::SmoothPixmapTransform, logical);
+        painter->drawImage(target, m_cpuBlur->result());
+        painter->restore();
+
+        ++m_statistics.softwareBlurs;
+        m_statistics.softwareBlurTime += std::chrono::nanoseconds(timer.nsecsElapsed());
+    }
+
+    bool BlurEffect::updateMask(BlurRenderData& renderInfo, QRegion const& blurShape, qreal scale, QSize const& size)
+    {
+        if (!renderInfo.mask || renderInfo.mask->size() != size) {
+            renderInfo.mask = KWin::GLTexture::allocate(GL_R8, size);
+            if (!renderInfo.mask) {
+                qCWarning(KWIN_BLUR) << "Failed to allocate a blur mask texture";
+                return false;
             }
+            renderInfo.mask->setFilter(GL_NEAREST);
+            renderInfo.mask->setWrapMode(GL_CLAMP_TO_EDGE);
         }
 
-        // Fetch the pixels behind the shape that is going to be blurred.
-        QRegion const dirtyRegion = region & backgroundRect;
-        for (QRect const& dirtyRect : dirtyRegion) {
-            renderInfo.framebuffers[0]->blitFromRenderTarget(renderTarget, viewport, dirtyRect, dirtyRect.translated(-backgroundRect.topLeft()));
+        // The rects are snapped to device pixels like the quads would be, the rows start at the bottom like the texture
+        QRect const backgroundRect = blurShape.boundingRect();
+        QRect const maskRect(QPoint(0, 0), size);
+        m_maskPixels.assign(size_t(size.width()) * size.height(), 0);
+        for (QRect const& rect : blurShape) {
+            QRect const deviceRect = KWin::snapToPixelGrid(KWin::scaledRect(rect.translated(-backgroundRect.topLeft()), scale)) & maskRect;
+            for (int y = deviceRect.top(); y <= deviceRect.bottom(); ++y) {
+                uchar* row = m_maskPixels.data() + size_t(size.height() - 1 - y) * size.width();
+                std::fill(row + deviceRect.left(), row + deviceRect.right() + 1, 0xff);
+            }
         }
 
-        // Upload the geometry: the first 6 vertices are used when down sampling and sampling offscreen,
-        // the remaining vertices are used when rendering on the screen.
-        KWin::GLVertexBuffer* vbo = KWin::GLVertexBuffer::streamingBuffer();
-        vbo->reset();
-        vbo->setAttribLayout(std::span(KWin::GLVertexBuffer::GLVertex2DLayout), sizeof(KWin::GLVertex2D));
+        renderInfo.mask->bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.width(), size.height(), GL_RED, GL_UNSIGNED_BYTE, m_maskPixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        renderInfo.mask->unbind();
+
+        ++m_statistics.maskUploads;
+        m_statistics.uploadedBytes += m_maskPixels.size();
+        return true;
+    }
 
-        int const vertexCount = effectiveShape.size() * 6;
-        if (auto result = vbo->map<KWin::GLVertex2D>(6 + vertexCount)) {
+    bool BlurEffect::updateGeometry(BlurRenderData& renderInfo, QRegion const& blurShape, qreal scale, bool allowMask)
+    {
+        // Shapes of many rects are drawn as a single quad that tests a mask of the shape,
+        // the quads and their draw calls would cost more than the extra texture fetch
+        bool masked = allowMask && blurShape.rectCount() > s_maskRectCount;
+        if (renderInfo.geometry && renderInfo.geometryShape == blurShape && renderInfo.geometryScale == scale && (renderInfo.mask != nullptr) == masked) {
+            return true;
+        }
+
+        QRect const backgroundRect = blurShape.boundingRect();
+        QRect const deviceBackgroundRect = KWin::snapToPixelGrid(KWin::scaledRect(backgroundRect, scale));
+
+        if (masked && !updateMask(renderInfo, blurShape, scale, deviceBackgroundRect.size())) {
+            masked = false;
+        }
+        if (!masked) {
+            renderInfo.mask.reset();
+        }
+
+        if (!renderInfo.geometry) {
+            renderInfo.geometry = std::make_unique<KWin::GLVertexBuffer>(KWin::GLVertexBuffer::Static);
+            renderInfo.geometry->setAttribLayout(std::span(KWin::GLVertexBuffer::GLVertex2DLayout), sizeof(KWin::GLVertex2D));
+        }
+
+        int const vertexCount = masked ? 6 : blurShape.rectCount() * 6;
+        if (auto result = renderInfo.geometry->map<KWin::GLVertex2D>(6 + vertexCount)) {
             auto map = *result;
 
             size_t vboIndex = 0;
 
             // The geometry that will be blurred offscreen, in logical pixels.
-            {
-                QRectF const localRect = QRectF(0, 0, backgroundRect.width(), backgroundRect.height());
-
-                float const x0 = localRect.left();
-                float const y0 = localRect.top();
-                float const x1 = localRect.right();
-                float const y1 = localRect.bottom();
-
-                float const u0 = x0 / backgroundRect.width();
-                float const v0 = 1.0f - y0 / backgroundRect.height();
-                float const u1 = x1 / backgroundRect.width();
-                float const v1 = 1.0f - y1 / backgroundRect.height();
-
-                // first triangle
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x0, y0),
-                    .texcoord = QVector2D(u0, v0),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x1, y1),
-                    .texcoord = QVector2D(u1, v1),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x0, y1),
-                    .texcoord = QVector2D(u0, v1),
-                };
-
-                // second triangle
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x0, y0),
-                    .texcoord = QVector2D(u0, v0),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x1, y0),
-                    .texcoord = QVector2D(u1, v0),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x1, y1),
-                    .texcoord = QVector2D(u1, v1),
-                };
-            }
+            QRectF const localRect(0, 0, backgroundRect.width(), backgroundRect.height());
+            appendQuad(map, vboIndex, localRect, localRect);
 
             // The geometry that will be painted on screen, in device pixels.
-            for (QRectF const& rect : effectiveShape) {
-                float const x0 = rect.left();
-                float const y0 = rect.top();
-                float const x1 = rect.right();
-                float const y1 = rect.bottom();
-
-                float const u0 = x0 / deviceBackgroundRect.width();
-                float const v0 = 1.0f - y0 / deviceBackgroundRect.height();
-                float const u1 = x1 / deviceBackgroundRect.width();
-                float const v1 = 1.0f - y1 / deviceBackgroundRect.height();
-
-                // first triangle
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x0, y0),
-                    .texcoord = QVector2D(u0, v0),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x1, y1),
-                    .texcoord = QVector2D(u1, v1),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x0, y1),
-                    .texcoord = QVector2D(u0, v1),
-                };
-
-                // second triangle
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x0, y0),
-                    .texcoord = QVector2D(u0, v0),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x1, y0),
-                    .texcoord = QVector2D(u1, v0),
-                };
-                map[vboIndex++] = KWin::GLVertex2D {
-                    .position = QVector2D(x1, y1),
-                    .texcoord = QVector2D(u1, v1),
-                };
+            QRectF const textureRect(0, 0, deviceBackgroundRect.width(), deviceBackgroundRect.height());
+            if (masked) {
+                appendQuad(map, vboIndex, textureRect, textureRect);
+            } else {
+                for (QRect const& rect : blurShape) {
+                    appendQuad(map, vboIndex, KWin::snapToPixelGridF(KWin::scaledRect(rect.translated(-backgroundRect.topLeft()), scale)), textureRect);
+                }
             }
 
+            renderInfo.geometry->unmap();
+        } else {
+            qCWarning(KWIN_BLUR) << "Failed to map vertex buffer";
+            renderInfo.geometry.reset();
+            return false;
+        }
+
+        renderInfo.geometryShape = blurShape;
+        renderInfo.geometryScale = scale;
+        renderInfo.geometryVertexCount = vertexCount;
+
+        ++m_statistics.geometryUploads;
+        m_statistics.uploadedBytes += (6 + vertexCount) * sizeof(KWin::GLVertex2D);
+        return true;
+    }
+
+    SharedBlur* BlurEffect::sharedBlurFor(BlurEffectData const& blurInfo, QRect const& backgroundRect)
+    {
+        if (blurInfo.sharedBlur < 0 || size_t(blurInfo.sharedBlur) >= m_sharedBlurs.size()) {
+            return nullptr;
+        }
+
+        // Blurring the union once only pays off if it's cheaper than what the windows would blur on their own
+        SharedBlur& shared = m_sharedBlurs[blurInfo.sharedBlur];
+        if (shared.failed || shared.members < 2 || qint64(shared.rect.width()) * shared.rect.height() >= shared.separateCost) {
+            return nullptr;
+        }
+
+        // The shape of transformed windows isn't where it was in prePaintWindow
+        if (!shared.rect.contains(backgroundRect)) {
+            return nullptr;
+        }
+
+        return &shared;
+    }
+
+    // The memory traffic of copying a part of the backdrop into the first level, it's read from the render target and written again
+    static qint64 backdropCopyBytes(QRect const& rect, qreal scale, GLenum outputFormat, GLenum format)
+    {
+        qint64 const area = qint64(rect.width()) * rect.height();
+        return qint64(area * scale * scale) * TexturePool::bytesPerPixel(outputFormat) + area * TexturePool::bytesPerPixel(format);
+    }
+
+    // How long a desktop has to stay unchanged before a blur of it is kept, in milliseconds
+    static constexpr int s_desktopSettleTime = 500;
+
+    // Whether everything behind the rect is painted in this frame, the render target holds the current backdrop then
+    static bool backdropRepainted(QRegion const& region, QRect const& rect)
+    {
+        return region == KWin::infiniteRegion() || (QRegion(rect) - region).isEmpty();
+    }
+
+    bool BlurEffect::renderSharedBlur(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, QRegion const& region, SharedBlur& shared, GLenum format, GLenum outputFormat)
+    {
+        shared.rendered = true;
+        if (!allocateRenderTargets(shared.render, shared.kernel, format, outputFormat, shared.rect.size())) {
+            shared.failed = true;
+            return false;
+        }
+
+        BackdropView backdrop;
+        bool const sampleBackdrop = backdropRepainted(region, shared.rect) && backdropView(renderTarget, viewport, shared.rect, &backdrop);
+        if (sampleBackdrop) {
+            ++m_statistics.backdropViews;
+            m_statistics.backdropSavedBytes += backdropCopyBytes(shared.rect, viewport.scale(), outputFormat, format);
+        } else {
+            // Only the repainted parts of the render target hold this frame's backdrop. The members grow the
+            // repainted region by their expand size, so whatever their kernels reach is in it. The rest of
+            // the union is cleared instead of blurring what earlier frames left there.
+            TextureLease const& background = shared.render.renderTargets[0];
+            QPoint const backgroundOffset(-shared.rect.x(), background.texture()->height() - background.size().height() - shared.rect.y());
+            QRegion const copyRegion = region & shared.rect;
+            if (!backdropRepainted(region, shared.rect)) {
+                KWin::GLFramebuffer::pushFramebuffer(background.framebuffer());
+                glClearColor(0.0, 0.0, 0.0, 0.0);
+                glClear(GL_COLOR_BUFFER_BIT);
+                KWin::GLFramebuffer::popFramebuffer();
+            }
+            for (QRect const& copyRect : copyRegion) {
+                background.framebuffer()->blitFromRenderTarget(renderTarget, viewport, copyRect, copyRect.translated(backgroundOffset));
+                m_statistics.backdropCopiedBytes += backdropCopyBytes(copyRect, viewport.scale(), outputFormat, format);
+            }
+        }
+
+        if (!renderSharedPyramid(shared, sampleBackdrop ? &backdrop : nullptr)) {
+            shared.failed = true;
+            return false;
+        }
+
+        ++m_statistics.shared;
+        return true;
+    }
+
+    // Streams the quad the pyramid passes draw for a background of the given size, for pyramids
+    // rendered without the geometry of a window
+    static KWin::GLVertexBuffer* streamPyramidQuad(QSize const& size)
+    {
+        KWin::GLVertexBuffer* vbo = KWin::GLVertexBuffer::streamingBuffer();
+        vbo->reset();
+        vbo->setAttribLayout(std::span(KWin::GLVertexBuffer::GLVertex2DLayout), sizeof(KWin::GLVertex2D));
+
+        if (auto result = vbo->map<KWin::GLVertex2D>(6)) {
+            size_t vboIndex = 0;
+            QRectF const localRect(0, 0, size.width(), size.height());
+            appendQuad(*result, vboIndex, localRect, localRect);
             vbo->unmap();
         } else {
             qCWarning(KWIN_BLUR) << "Failed to map vertex buffer";
-            return;
+            return nullptr;
+        }
+        return vbo;
+    }
+
+    bool BlurEffect::renderSharedPyramid(SharedBlur& shared, BackdropView const* backdrop)
+    {
+        KWin::GLVertexBuffer* vbo = streamPyramidQuad(shared.rect.size());
+        if (!vbo) {
+            return false;
         }
 
         vbo->bindArrays();
+        renderPyramid(vbo, shared.render, shared.kernel, shared.rect.size(), nullptr, nullptr, backdrop);
+        vbo->unbindArrays();
+        return true;
+    }
 
-        // The downsample pass of the dual Kawase algorithm: the background will be scaled down 50% every iteration.
-        {
-            KWin::ShaderManager::instance()->pushShader(m_downsamplePass.shader.get());
+    bool BlurEffect::desktopBlurCurrent(KWin::EffectWindow* desktop, DesktopBlur const& desktopBlur, GLenum outputFormat) const
+    {
+        QRect const area = desktop->frameGeometry().toAlignedRect() & m_screenArea;
+        BlurRenderData const& render = desktopBlur.blur.render;
+        return desktopBlur.valid
+            && desktopBlur.blur.rect == area
+            && desktopBlur.blur.kernel == m_kernel
+            && render.renderTargets.size() == m_kernel.iterationCount + 1
+            && render.upsampleRenderTargets.size() == m_kernel.iterationCount - 1
+            && (m_kernel.iterationCount > 1 ? render.upsampleRenderTargets[0] : render.renderTargets[1]).texture()->internalFormat() == outputFormat;
+    }
 
-            QMatrix4x4 projectionMatrix;
-            projectionMatrix.ortho(QRectF(0.0, 0.0, backgroundRect.width(), backgroundRect.height()));
+    SharedBlur* BlurEffect::desktopBlurFor(BlurEffectData const& blurInfo, BlurKernel const& kernel, QRect const& backgroundRect, GLenum outputFormat)
+    {
+        // The desktop is blurred with the configured strength, windows asking for another one blur their backdrop
+        if (!blurInfo.desktop || kernel != m_kernel) {
+            return nullptr;
+        }
 
-            m_downsamplePass.shader->setUniform(m_downsamplePass.mvpMatrixLocation, projectionMatrix);
-            m_downsamplePass.shader->setUniform(m_downsamplePass.offsetLocation, float(m_offset));
+        // The blur is brought up to date when the desktop is drawn, unless it keeps changing
+        auto const screens = m_desktopBlurs.find(blurInfo.desktop);
+        if (screens == m_desktopBlurs.end()) {
+            return nullptr;
+        }
+        auto const it = screens->second.find(m_currentScreen);
+        if (it == screens->second.end() || !desktopBlurCurrent(blurInfo.desktop, it->second, outputFormat)) {
+            return nullptr;
+        }
+
+        // The shape of transformed windows isn't where it was in prePaintWindow
+        DesktopBlur& desktopBlur = it->second;
+        if (!desktopBlur.blur.rect.contains(backgroundRect)) {
+            return nullptr;
+        }
+
+        return &desktopBlur.blur;
+    }
+
+    void BlurEffect::updateDesktopBlur(KWin::RenderTarget const& renderTarget, KWin::EffectWindow* desktop)
+    {
+        if (m_cpuBlur) {
+            return;
+        }
 
-            for (size_t i = 1; i < renderInfo.framebuffers.size(); ++i) {
-                auto const& read = renderInfo.framebuffers[i - 1];
-                auto const& draw = renderInfo.framebuffers[i];
+        // A desktop that keeps changing, like an animated wallpaper, would be blurred again in every frame
+        DesktopBlur& desktopBlur = m_desktopBlurs[desktop][m_currentScreen];
+        if (desktopBlur.damaged.isValid() && !desktopBlur.damaged.hasExpired(s_desktopSettleTime)) {
+            return;
+        }
 
-                QVector2D const halfpixel(0.5 / read->colorAttachment()->width(), 0.5 / read->colorAttachment()->height());
-                m_downsamplePass.shader->setUniform(m_downsamplePass.halfpixelLocation, halfpixel);
+        GLenum const outputFormat = renderTarget.texture() ? renderTarget.texture()->internalFormat() : GL_RGBA8;
+        if (!desktopBlurCurrent(desktop, desktopBlur, outputFormat)) {
+            QRect const area = desktop->frameGeometry().toAlignedRect() & m_screenArea;
+            renderDesktopBlur(desktop, desktopBlur, area, intermediateFormat(outputFormat), outputFormat);
+        }
+    }
 
-                read->colorAttachment()->bind();
+    bool BlurEffect::renderDesktopBlur(KWin::EffectWindow* desktop, DesktopBlur& desktopBlur, QRect const& area, GLenum format, GLenum outputFormat)
+    {
+        desktopBlur.valid = false;
+        desktopBlur.blur.rect = area;
+        desktopBlur.blur.rendered = true;
+        desktopBlur.blur.kernel = m_kernel;
+
+        BlurRenderData& render = desktopBlur.blur.render;
+        if (area.isEmpty() || !allocateRenderTargets(render, m_kernel, format, outputFormat, area.size())) {
+            render.renderTargets.clear();
+            render.upsampleRenderTargets.clear();
+            return false;
+        }
 
-                KWin::GLFramebuffer::pushFramebuffer(draw.get());
-                vbo->draw(GL_TRIANGLES, 0, 6);
+        // The desktop is drawn on its own into the first level, in logical pixels like a copied backdrop.
+        // The viewport covers the whole texture with the content in its bottom left corner. This only
+        // runs from the desktop's own drawWindow, which continues the effect chain a second time.
+        TextureLease const& background = render.renderTargets[0];
+        QSize const textureSize = background.texture()->size();
+        KWin::RenderTarget offscreen(background.framebuffer());
+        KWin::RenderViewport const offscreenViewport(QRectF(area.x(), area.y() + area.height() - textureSize.height(), textureSize.width(), textureSize.height()), 1.0, offscreen);
+
+        KWin::GLFramebuffer::pushFramebuffer(background.framebuffer());
+        glClearColor(0.0, 0.0, 0.0, 0.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        KWin::WindowPaintData data;
+        KWin::effects->drawWindow(offscreen, offscreenViewport, desktop, PAINT_WINDOW_TRANSFORMED | PAINT_WINDOW_TRANSLUCENT, KWin::infiniteRegion(), data);
+        KWin::GLFramebuffer::popFramebuffer();
+
+        if (!renderSharedPyramid(desktopBlur.blur, nullptr)) {
+            return false;
+        }
+
+        // Only the level read by the final pass has to be kept
+        for (size_t i = 0; i < render.renderTargets.size(); ++i) {
+            if (i != 1 || m_kernel.iterationCount > 1) {
+                render.renderTargets[i] = TextureLease();
             }
+        }
+        for (size_t i = 1; i < render.upsampleRenderTargets.size(); ++i) {
+            render.upsampleRenderTargets[i] = TextureLease();
+        }
 
-            KWin::ShaderManager::instance()->popShader();
+        desktopBlur.valid = true;
+        ++m_statistics.desktopBlurs;
+        return true;
+    }
+
+    bool BlurEffect::allocateRenderTargets(BlurRenderData& renderInfo, BlurKernel const& kernel, GLenum format, GLenum outputFormat, QSize const& size)
+    {
+        // A level whose texture still fits the new size keeps it, only its content size changes
+        auto updateLevel = [this](TextureLease& lease, GLenum format, QSize const& levelSize) {
+            if (lease.isValid() && lease.texture()->internalFormat() == format && lease.texture()->size() == TexturePool::bucketSize(levelSize)) {
+                lease.setSize(levelSize);
+                return true;
+            }
+            lease = m_texturePool.acquire(format, levelSize);
+            return lease.isValid();
+        };
+
+        renderInfo.renderTargets.resize(kernel.iterationCount + 1);
+        renderInfo.upsampleRenderTargets.resize(kernel.iterationCount - 1);
+
+        // The level read by the final pass keeps the precision of the output, the others use the intermediate format
+        // Small areas run out of pixels before the deepest levels, those keep a single one
+        auto levelSize = [&size](size_t level) {
+            return QSize(std::max(1, size.width() >> level), std::max(1, size.height() >> level));
+        };
+        for (size_t i = 0; i <= kernel.iterationCount; ++i) {
+            bool const finalLevel = i == 1 && kernel.iterationCount == 1;
+            if (!updateLevel(renderInfo.renderTargets[i], finalLevel ? outputFormat : format, levelSize(i))) {
+                return false;
+            }
+        }
+        for (size_t i = 1; i < kernel.iterationCount; ++i) {
+            if (!updateLevel(renderInfo.upsampleRenderTargets[i - 1], i == 1 ? outputFormat : format, levelSize(i))) {
+                return false;
+            }
         }
+        return true;
+    }
 
-        // The upsample pass of the dual Kawase algorithm: the background will be scaled up 200% every iteration.
-        {
-            KWin::ShaderManager::instance()->pushShader(m_upsamplePass.shader.get());
+    void BlurEffect::releaseIdleRenderTargets()
+    {
+        // Windows that weren't painted in the last frame have lost their cached blur anyway,
+        // their render targets are better spent on other windows until they come back.
+        for (auto& [window, data] : m_windows) {
+            if (auto it = data.render.find(m_currentScreen); it != data.render.end()) {
+                BlurRenderData& renderInfo = it->second;
+                if (renderInfo.lastPrePaintFrame + 1 < m_currentFrame && !renderInfo.renderTargets.empty()) {
+                    renderInfo.renderTargets.clear();
+                    renderInfo.upsampleRenderTargets.clear();
+                    renderInfo.blurValid = false;
+                    renderInfo.backgroundValid = false;
+                }
+            }
+        }
+    }
 
-            QMatrix4x4 projectionMatrix;
-            projectionMatrix.ortho(QRectF(0.0, 0.0, backgroundRect.width(), backgroundRect.height()));
+    void BlurEffect::blur(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, KWin::EffectWindow* w, int mask, QRegion const& region, KWin::WindowPaintData& data)
+    {
+        auto it = m_windows.find(w);
+        if (it == m_windows.end()) {
+            return;
+        }
 
-            m_upsamplePass.shader->setUniform(m_upsamplePass.mvpMatrixLocation, projectionMatrix);
-            m_upsamplePass.shader->setUniform(m_upsamplePass.offsetLocation, float(m_offset));
+        BlurEffectData& blurInfo = it->second;
+        BlurRenderData& renderInfo = blurInfo.render[m_currentScreen];
+        if (!shouldBlur(w, mask, data)) {
+            return;
+        }
+        BlurKernel const kernel = kernelFor(blurInfo);
 
-            for (size_t i = renderInfo.framebuffers.size() - 1; i > 1; --i) {
-                KWin::GLFramebuffer::popFramebuffer();
-                auto const& read = renderInfo.framebuffers[i];
+        // Compute the effective blur shape. Note that if the window is transformed, so will be the blur shape.
+        // The rounded corners aren't part of the shape, they are clipped per pixel in the final pass.
+        QRegion const windowShape = blurRegion(w).translated(w->pos().toPoint());
+        QRegion blurShape = windowShape;
+        LSHelper::CornerShape corners;
+        bool const rounded = m_helper->cornerShape(w, &corners);
+        if (data.xScale() != 1 || data.yScale() != 1) {
+            QPoint const origin = blurShape.boundingRect().topLeft();
+            m_transformedShape.assign(blurShape);
+            m_transformedShape.transform(origin, data.xScale(), data.yScale(), QPointF(data.xTranslation(), data.yTranslation()));
+            blurShape = m_transformedShape.toRegion();
+
+            QPointF const topLeft = corners.frame.topLeft() - origin;
+            corners.frame = QRectF(origin.x() + topLeft.x() * data.xScale() + data.xTranslation(), origin.y() + topLeft.y() * data.yScale() + data.yTranslation(),
+                                   corners.frame.width() * data.xScale(), corners.frame.height() * data.yScale());
+            corners.radius = int(std::round(corners.radius * std::min(data.xScale(), data.yScale())));
+        } else if (data.xTranslation() || data.yTranslation()) {
+            blurShape.translate(std::round(data.xTranslation()), std::round(data.yTranslation()));
+            corners.frame.translate(std::round(data.xTranslation()), std::round(data.yTranslation()));
+        }
 
-                QVector2D const halfpixel(0.5 / read->colorAttachment()->width(), 0.5 / read->colorAttachment()->height());
-                m_upsamplePass.shader->setUniform(m_upsamplePass.halfpixelLocation, halfpixel);
+        QRect const backgroundRect = blurShape.boundingRect();
+        QRect const deviceBackgroundRect = KWin::snapToPixelGrid(KWin::scaledRect(backgroundRect, viewport.scale()));
+        auto const opacity = w->opacity() * data.opacity();
 
-                read->colorAttachment()->bind();
+        // Unless the blur is forced to follow the window, a transformed window keeps the blur of its untransformed
+        // backdrop and draws it with its transform. The backdrop is blurred again once the transformation ends.
+        bool const frozen = m_blurTransformedWindows && isTransformed(mask, data) && !w->data(KWin::WindowForceBlurRole).toBool();
+        QRegion const& captureShape = frozen ? windowShape : blurShape;
+        QRect const captureRect = captureShape.boundingRect();
+
+        // Only the parts of the shape inside the repainted region are drawn, the rest is scissored away.
+        // It's possible that all of it will be clipped.
+        bool const clipped = region != KWin::infiniteRegion();
+        QRegion const clip = clipped ? (region & backgroundRect) : QRegion();
+        if (clipped && !clip.intersects(blurShape)) {
+            return;
+        }
 
-                vbo->draw(GL_TRIANGLES, 0, 6);
-            }
+        if (m_cpuBlur) {
+            blurSoftware(renderTarget, viewport, kernel, blurShape, rounded ? &corners : nullptr, opacity, clipped ? (clip & blurShape) : blurShape);
+            return;
+        }
 
-            // The last upsampling pass is rendered on the screen, not in framebuffers[0].
-            KWin::GLFramebuffer::popFramebuffer();
-            auto const& read = renderInfo.framebuffers[1];
+        // Maybe reallocate offscreen render targets. Keep in mind that the first one contains
+        // original background behind the window, it's not blurred.
+        GLenum textureFormat = GL_RGBA8;
+        if (renderTarget.texture()) {
+            textureFormat = renderTarget.texture()->internalFormat();
+        }
+        GLenum const pyramidFormat = intermediateFormat(textureFormat);
+        m_lastIntermediateFormat = pyramidFormat;
 
-            projectionMatrix = viewport.projectionMatrix();
-            projectionMatrix.translate(deviceBackgroundRect.x(), deviceBackgroundRect.y());
-            m_upsamplePass.shader->setUniform(m_upsamplePass.mvpMatrixLocation, projectionMatrix);
+        // The strengths are calibrated for the most expensive output, an HDR one once it shows up
+        if (TexturePool::bytesPerPixel(textureFormat) > TexturePool::bytesPerPixel(m_outputFormat)) {
+            m_outputFormat = textureFormat;
+            loadCalibration();
+        }
 
-            QVector2D const halfpixel(0.5 / read->colorAttachment()->width(), 0.5 / read->colorAttachment()->height());
-            m_upsamplePass.shader->setUniform(m_upsamplePass.halfpixelLocation, halfpixel);
+        while (auto const pyramidTime = m_pyramidTimer->result()) {
+            ++m_statistics.timedPyramids;
+            m_statistics.pyramidTime += *pyramidTime;
+            m_frameBlurTime += *pyramidTime;
+        }
 
-            read->colorAttachment()->bind();
+        // Windows above nothing but the desktop sample its kept blur, windows that share their backdrop
+        // with others may sample the blur of all of them instead.
+        SharedBlur* const desktopBlur = frozen ? nullptr : desktopBlurFor(blurInfo, kernel, backgroundRect, textureFormat);
+        SharedBlur* shared = (frozen || desktopBlur) ? desktopBlur : sharedBlurFor(blurInfo, backgroundRect);
+        if (shared && !shared->rendered && !renderSharedBlur(renderTarget, viewport, region, *shared, pyramidFormat, textureFormat)) {
+            shared = nullptr;
+        }
 
-            // Modulate the blurred texture with the window opacity if the window isn't opaque
-            if (opacity < 1.0) {
-                glEnable(GL_BLEND);
-                float o = 1.0f - (opacity);
-                o = 1.0f - o * o;
-                glBlendColor(0, 0, 0, o);
-                glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+        bool reuseBlur = false;
+        bool partialBlur = false;
+        BackdropView backdrop;
+        bool sampleBackdrop = false;
+        std::vector<QRegion> downsampleDamage;
+        std::vector<QRegion> upsampleDamage;
+
+        ++m_statistics.blurs;
+        if (desktopBlur) {
+            ++m_statistics.desktopWindows;
+        } else if (shared) {
+            ++m_statistics.sharedWindows;
+        } else {
+            if (renderInfo.renderTargets.size() != (kernel.iterationCount + 1) || renderInfo.upsampleRenderTargets.size() != (kernel.iterationCount - 1) || renderInfo.renderTargets[0].size() != captureRect.size() || renderInfo.renderTargets[0].texture()->internalFormat() != pyramidFormat || (kernel.iterationCount > 1 ? renderInfo.upsampleRenderTargets[0] : renderInfo.renderTargets[1]).texture()->internalFormat() != textureFormat) {
+                renderInfo.blurValid = false;
+                renderInfo.blurRect = QRect();
+                renderInfo.backgroundValid = false;
+
+                if (!allocateRenderTargets(renderInfo, kernel, pyramidFormat, textureFormat, captureRect.size())) {
+                    renderInfo.renderTargets.clear();
+                    renderInfo.upsampleRenderTargets.clear();
+                    return;
+                }
+            }
+
+            // The last blurred background can be reused if nothing behind the window has been repainted since,
+            // otherwise only the damaged parts of the pyramid have to be rendered again. A frozen blur is
+            // reused even if the backdrop changed, unless a restack or a desktop switch has discarded it.
+            bool const blurCached = renderInfo.blurValid
+                && renderInfo.blurRect == captureRect
+                && renderInfo.blurScale == viewport.scale()
+                && renderInfo.blurKernel == kernel;
+            QRect const localBackgroundRect(QPoint(0, 0), captureRect.size());
+            QRegion const backdropDamage = renderInfo.backdropDamage.translated(-captureRect.topLeft()) & localBackgroundRect;
+            reuseBlur = blurCached && (frozen || backdropDamage.isEmpty());
+
+            // Over a backdrop that changes in every frame, like a video, the blur only follows at the capped rate.
+            // The damage is kept and blurred once the interval has passed.
+            if (blurCached && !reuseBlur && m_refreshInterval.count() > 0 && m_presentTime - renderInfo.lastBlurTime < m_refreshInterval) {
+                reuseBlur = true;
+                deferBlur(captureRect, renderInfo.lastBlurTime + m_refreshInterval);
+                ++m_statistics.deferred;
             }
 
-            vbo->draw(GL_TRIANGLES, 6, vertexCount);
+            // If all of the backdrop has been painted again, the first downsample pass can read it straight
+            // from the render target and the copy into the first level is skipped.
+            sampleBackdrop = !reuseBlur && backdropRepainted(region, captureRect) && backdropView(renderTarget, viewport, captureRect, &backdrop);
+
+            // The damage of every level in logical pixels, grown by the footprint of the passes that read it.
+            // Without the render target, a partial update needs the undamaged backdrop in the first level.
+            downsampleDamage.resize(kernel.iterationCount + 1);
+            upsampleDamage.resize(kernel.iterationCount);
+            if (blurCached && !reuseBlur && (sampleBackdrop || renderInfo.backgroundValid)) {
+                int growth = 0;
+                for (size_t i = 1; i <= kernel.iterationCount; ++i) {
+                    growth = std::min<int>(growth + std::ceil((kernel.offset / 2.0 + 1.0) * (1 << (i - 1))), kernel.expandSize);
+                    downsampleDamage[i] = grownRegion(backdropDamage, growth, localBackgroundRect);
+                }
+                for (size_t i = kernel.iterationCount - 1; i >= 1; --i) {
+                    growth = std::min<int>(growth + std::ceil((kernel.offset + 1.0) * (1 << (i + 1))), kernel.expandSize);
+                    upsampleDamage[i] = grownRegion(backdropDamage, growth, localBackgroundRect);
+                }
 
-            if (opacity < 1.0) {
-                glDisable(GL_BLEND);
+                // Tracking the damage doesn't pay off once it covers most of the window.
+                QRect const damageBounds = grownRegion(backdropDamage, growth, localBackgroundRect).boundingRect();
+                partialBlur = qint64(damageBounds.width()) * damageBounds.height() * 2 < qint64(captureRect.width()) * captureRect.height();
             }
 
-            KWin::ShaderManager::instance()->popShader();
+            if (frozen && reuseBlur) {
+                ++m_statistics.frozenReused;
+            } else if (frozen) {
+                ++m_statistics.frozenCaptures;
+            }
+            if (reuseBlur) {
+                ++m_statistics.reused;
+            } else if (sampleBackdrop) {
+                ++m_statistics.backdropViews;
+                m_statistics.backdropSavedBytes += backdropCopyBytes(captureRect, viewport.scale(), textureFormat, pyramidFormat);
+                renderInfo.backgroundValid = false;
+                if (partialBlur) {
+                    ++m_statistics.partial;
+                }
+            } else {
+                // Fetch the pixels behind the shape that is going to be blurred. Elsewhere the cached background is still valid.
+                QRegion const dirtyRegion = partialBlur ? (region & backdropDamage.translated(captureRect.topLeft())) : (region & captureRect);
+                // The content is kept in the bottom left corner of the texture, which may be larger.
+                TextureLease const& background = renderInfo.renderTargets[0];
+                QPoint const backgroundOffset(-captureRect.x(), background.texture()->height() - background.size().height() - captureRect.y());
+                for (QRect const& dirtyRect : dirtyRegion) {
+                    background.framebuffer()->blitFromRenderTarget(renderTarget, viewport, dirtyRect, dirtyRect.translated(backgroundOffset));
+                    m_statistics.backdropCopiedBytes += backdropCopyBytes(dirtyRect, viewport.scale(), textureFormat, pyramidFormat);
+                }
+                renderInfo.backgroundValid = true;
+                if (partialBlur) {
+                    ++m_statistics.partial;
+                }
+            }
+        }
+        BlurRenderData const& source = shared ? shared->render : renderInfo;
+
+        // The first 6 vertices are used when down sampling and sampling offscreen, the remaining vertices
+        // are used when rendering on the screen. They only have to be uploaded when the shape changes.
+        bool const renderBlur = !shared && !reuseBlur;
+        // The mask is placed in gl_FragCoord coordinates, which doesn't work for rotated or flipped outputs
+        bool const allowMask = renderTarget.transform().kind() == KWin::OutputTransform::Normal;
+        if (!updateGeometry(renderInfo, blurShape, viewport.scale(), allowMask)) {
+            return;
         }
 
-        if (m_noiseStrength > 0) {
-            // Apply an additive noise onto the blurred image. The noise is useful to mask banding
-            // artifacts, which often happens due to the smooth color transitions in the blurred image.
+        KWin::GLVertexBuffer* vbo = renderInfo.geometry.get();
 
-            glEnable(GL_BLEND);
-            if (opacity < 1.0) {
-                glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE);
-            } else {
-                glBlendFunc(GL_ONE, GL_ONE);
+        if (renderBlur) {
+            // The backdrop of a frozen window is captured with its untransformed shape and drawn with the
+            // transformed one, the quad of its pyramid is streamed instead of uploading both shapes
+            KWin::GLVertexBuffer* pyramidVbo = frozen ? streamPyramidQuad(captureRect.size()) : vbo;
+            if (!pyramidVbo) {
+                return;
             }
+            pyramidVbo->bindArrays();
+            renderPyramid(pyramidVbo, renderInfo, kernel, captureRect.size(), partialBlur ? &downsampleDamage : nullptr, partialBlur ? &upsampleDamage : nullptr, sampleBackdrop ? &backdrop : nullptr);
+            pyramidVbo->unbindArrays();
+
+            renderInfo.blurValid = true;
+            renderInfo.blurRect = captureRect;
+            renderInfo.blurScale = viewport.scale();
+            renderInfo.blurKernel = kernel;
+            renderInfo.lastBlurTime = m_presentTime;
+            renderInfo.backdropDamage = QRegion();
+        }
+        vbo->bindArrays();
+        int const vertexCount = renderInfo.geometryVertexCount;
+
+        // The last upsample pass, it's rendered on the screen. The noise and the window opacity are applied
+        // in the same pass, so every blurred pixel is written once.
+        {
+            KWin::ShaderManager::instance()->pushShader(m_finalPass.shader.get());
 
-            if (KWin::GLTexture* noiseTexture = ensureNoiseTexture()) {
-                KWin::ShaderManager::instance()->pushShader(m_noisePass.shader.get());
+            TextureLease const& read = (kernel.iterationCount > 1) ? source.upsampleRenderTargets[0] : source.renderTargets[1];
+
+            QMatrix4x4 projectionMatrix = viewport.projectionMatrix();
+            projectionMatrix.translate(deviceBackgroundRect.x(), deviceBackgroundRect.y());
+            m_finalPass.shader->setUniform(m_finalPass.mvpMatrixLocation, projectionMatrix);
+            m_finalPass.shader->setUniform(m_finalPass.offsetLocation, float(kernel.offset));
+
+            QVector2D const halfpixel(0.5 / read.texture()->width(), 0.5 / read.texture()->height());
+            m_finalPass.shader->setUniform(m_finalPass.halfpixelLocation, halfpixel);
+            m_finalPass.shader->setUniform(m_finalPass.textureBoundsLocation, read.textureBounds());
+
+            // The geometry maps the window's background rect to the texture, a shared blur covers more than that
+            QVector2D textureScale = read.textureScale();
+            QVector2D textureOffset;
+            if (shared) {
+                QRectF const sharedRect = KWin::snapToPixelGrid(KWin::scaledRect(shared->rect, viewport.scale())).translated(-deviceBackgroundRect.topLeft());
+                textureOffset = QVector2D(-sharedRect.x() / sharedRect.width(), 1.0 - (deviceBackgroundRect.height() - sharedRect.y()) / sharedRect.height()) * textureScale;
+                textureScale *= QVector2D(deviceBackgroundRect.width() / sharedRect.width(), deviceBackgroundRect.height() / sharedRect.height());
+            }
+            m_finalPass.shader->setUniform(m_finalPass.textureScaleLocation, textureScale);
+            m_finalPass.shader->setUniform(m_finalPass.textureOffsetLocation, textureOffset);
+
+            // The noise is an additive dither, it masks banding artifacts caused by the smooth color transitions.
+            qreal const noiseScale = std::max(1.0, QGuiApplication::primaryScreen()->logicalDotsPerInch() / 96.0);
+            m_finalPass.shader->setUniform(m_finalPass.noiseStrengthLocation, float(m_noiseStrength));
+            m_finalPass.shader->setUniform(m_finalPass.noiseScaleLocation, float(noiseScale));
+
+            // The frame corners in gl_FragCoord coordinates, which start at the bottom of the render target
+            float cornerRadius = 0.0f;
+            if (rounded) {
+                QRectF const deviceFrame = viewport.mapToRenderTarget(corners.frame);
+                int const height = renderTarget.size().height();
+                cornerRadius = std::min({corners.radius * viewport.scale(), deviceFrame.width() / 2, deviceFrame.height() / 2});
+                m_finalPass.shader->setUniform(m_finalPass.cornerRectLocation, QVector4D(deviceFrame.left(), height - deviceFrame.bottom(), deviceFrame.right(), height - deviceFrame.top()));
+                m_finalPass.shader->setUniform(m_finalPass.cornerExponentLocation, float(corners.squircleRatio));
+            }
+            m_finalPass.shader->setUniform(m_finalPass.cornerRadiusLocation, cornerRadius);
+
+            // The mask covers the background rect, it's bound to the second texture unit
+            bool const masked = renderInfo.mask != nullptr;
+            if (masked) {
+                QRect const deviceMaskRect = viewport.mapToRenderTarget(backgroundRect);
+                QSize const maskSize = renderInfo.mask->size();
+                int const height = renderTarget.size().height();
+                m_finalPass.shader->setUniform(m_finalPass.maskRectLocation, QVector4D(deviceMaskRect.x(), height - (deviceMaskRect.y() + maskSize.height()), 1.0 / maskSize.width(), 1.0 / maskSize.height()));
+                m_finalPass.shader->setUniform(m_finalPass.maskUnitLocation, 1);
+                glActiveTexture(GL_TEXTURE1);
+                renderInfo.mask->bind();
+                glActiveTexture(GL_TEXTURE0);
+            }
+            m_finalPass.shader->setUniform(m_finalPass.maskEnabledLocation, masked ? 1.0f : 0.0f);
 
-                QMatrix4x4 projectionMatrix = viewport.projectionMatrix();
-                projectionMatrix.translate(deviceBackgroundRect.x(), deviceBackgroundRect.y());
+            // Modulate the blurred texture with the window opacity if the window isn't opaque
+            float o = 1.0f;
+            if (opacity < 1.0) {
+                o = 1.0f - (opacity);
+                o = 1.0f - o * o;
+            }
+            m_finalPass.shader->setUniform(m_finalPass.opacityLocation, o);
 
-                m_noisePass.shader->setUniform(m_noisePass.mvpMatrixLocation, projectionMatrix);
-                m_noisePass.shader->setUniform(m_noisePass.noiseTextureSizeLocation, QVector2D(noiseTexture->width(), noiseTexture->height()));
-                m_noisePass.shader->setUniform(m_noisePass.texStartPosLocation, QVector2D(deviceBackgroundRect.topLeft()));
+            // Both the opacity and the corner coverage end up in the source alpha
+            bool const blend = opacity < 1.0 || cornerRadius > 0.0f || masked;
+            if (blend) {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            }
+            m_statistics.quads += vertexCount / 6;
 
-                noiseTexture->bind();
+            read.texture()->bind();
 
+            if (clipped) {
+                glEnable(GL_SCISSOR_TEST);
+                for (QRect const& clipRect : clip) {
+                    QRect const deviceClipRect = viewport.mapToRenderTarget(clipRect);
+                    glScissor(deviceClipRect.x(), renderTarget.size().height() - (deviceClipRect.y() + deviceClipRect.height()), deviceClipRect.width(), deviceClipRect.height());
+                    vbo->draw(GL_TRIANGLES, 6, vertexCount);
+                }
+                glDisable(GL_SCISSOR_TEST);
+            } else {
                 vbo->draw(GL_TRIANGLES, 6, vertexCount);
+            }
 
-                KWin::ShaderManager::instance()->popShader();
+            if (blend) {
+                glDisable(GL_BLEND);
+            }
+            if (masked) {
+                glActiveTexture(GL_TEXTURE1);
+                renderInfo.mask->unbind();
+                glActiveTexture(GL_TEXTURE0);
             }
 
-            glDisable(GL_BLEND);
+            KWin::ShaderManager::instance()->popShader();
         }
 
         vbo->unbindArrays();
@@ -854,6 +2133,79 @@ namespace Lightly {
         return false;
     }
 
+    QString BlurEffect::debug(QString const& parameter) const
+    {
+        Q_UNUSED(parameter)
+
+        // Reached with: qdbus org.kde.KWin /Effects org.kde.kwin.Effects.debug lightlyshaders_blur ""
+        QString result;
+        QDebug stream(&result);
+        stream.nospace();
+
+        double const hitRate = m_statistics.blurs ? 100.0 * m_statistics.reused / m_statistics.blurs : 0.0;
+        stream << "blurred windows: " << m_statistics.blurs << ", reused: " << m_statistics.reused << " (" << hitRate << "%)"
+               << ", partially blurred: " << m_statistics.partial << ", held back by the refresh cap: " << m_statistics.deferred
+               << "\nshared blurs: " << m_statistics.shared << ", windows using them: " << m_statistics.sharedWindows
+               << "\ndesktops blurred: " << m_statistics.desktopBlurs << ", windows sampling them: " << m_statistics.desktopWindows;
+
+        double const quadsPerBlur = m_statistics.blurs ? double(m_statistics.quads) / m_statistics.blurs : 0.0;
+        stream << "\nquads per blurred window: " << quadsPerBlur << ", shape masks uploaded: " << m_statistics.maskUploads;
+        double const savedKiBPerBlur = m_statistics.blurs ? m_statistics.backdropSavedBytes / 1024.0 / m_statistics.blurs : 0.0;
+        stream << "\nbackdrops sampled from the render target: " << m_statistics.backdropViews
+               << ", copied: " << m_statistics.backdropCopiedBytes / (1024 * 1024) << " MiB"
+               << ", copies saved: " << m_statistics.backdropSavedBytes / (1024 * 1024) << " MiB (" << savedKiBPerBlur << " KiB per blurred window)";
+        stream << "\ntransformed windows: " << m_statistics.frozenReused << " frames drawn from the kept blur, "
+               << m_statistics.frozenCaptures << " backdrops captured";
+
+        if (m_statistics.timedPyramids) {
+            double const averageMs = std::chrono::duration<double, std::milli>(m_statistics.pyramidTime).count() / m_statistics.timedPyramids;
+            stream << "\naverage blur pass: " << averageMs << " ms, saved: " << averageMs * m_statistics.reused << " ms";
+        } else {
+            stream << "\nGPU timings are not available";
+        }
+        if (m_governor.isEnabled()) {
+            double const averageMs = std::chrono::duration<double, std::milli>(m_governor.averageTime()).count();
+            double const budgetMs = std::chrono::duration<double, std::milli>(m_governor.frameBudget()).count();
+            stream << "\nadaptive quality: " << m_governor.level() << " steps below full quality (" << m_kernel.iterationCount << " iterations, offset " << m_kernel.offset << ")"
+                   << ", blur passes take " << averageMs << " of " << budgetMs << " ms per frame, changes: " << m_governor.levelChanges();
+        } else {
+            stream << "\nadaptive quality is disabled";
+        }
+        stream << "\nintermediate format: 0x" << Qt::hex << m_lastIntermediateFormat << Qt::dec;
+        if (m_cpuBlur) {
+            double const averageMs = m_statistics.softwareBlurs ? std::chrono::duration<double, std::milli>(m_statistics.softwareBlurTime).count() / m_statistics.softwareBlurs : 0.0;
+            stream << "\nbackend: CPU with " << m_cpuBlur->threadCount() << " threads, " << averageMs << " ms per blurred window";
+        } else {
+            stream << "\nbackend: " << (m_computeBlur ? "compute shaders" : (m_reducedTaps ? "fragment shaders with reduced taps" : "fragment shaders"));
+        }
+
+        if (m_statistics.frames) {
+            double const bytesPerFrame = double(m_statistics.uploadedBytes) / m_statistics.frames;
+            double const cpuUsPerFrame = std::chrono::duration<double, std::micro>(m_statistics.cpuTime).count() / m_statistics.frames;
+            stream << "\nper frame: " << bytesPerFrame << " bytes of geometry uploaded, " << cpuUsPerFrame << " us of CPU time in blur()"
+                   << ", geometry uploads: " << m_statistics.geometryUploads;
+        }
+
+        if (m_statistics.frames) {
+            double const prePaintUsPerFrame = std::chrono::duration<double, std::micro>(m_statistics.prePaintTime).count() / m_statistics.frames;
+            double const windowsPerFrame = double(m_statistics.prePaintWindows) / m_statistics.frames;
+            stream << "\nprePaintScreen + prePaintWindow: " << prePaintUsPerFrame << " us per frame for " << windowsPerFrame << " windows";
+        }
+
+        stream << "\nblur region updates received: " << m_statistics.regionUpdatesReceived
+               << ", processed: " << m_statistics.regionUpdatesProcessed << ", unchanged: " << m_statistics.regionUpdatesDropped;
+
+        if (m_calibration) {
+            stream << "\nstrength calibration: " << (m_calibration->isRunning() ? "running, " : "idle, ") << 100.0 * m_calibration->progress() << "% measured"
+                   << ", pipeline: " << m_calibrationPipeline;
+        }
+
+        stream << "\ntexture pool: " << m_texturePool.bytes() / (1024 * 1024) << " MiB, allocations: " << m_texturePool.allocations()
+               << " (" << m_texturePool.allocationsPerSecond() << "/s)";
+
+        return result;
+    }
+
 } // namespace KWin
 
 #include "moc_blur.cpp"
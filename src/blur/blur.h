@@ -11,11 +11,22 @@
 #include "opengl/glutils.h"
 #include "scene/item.h"
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
+#include <QTimer>
 
 #include <unordered_map>
+#include <unordered_set>
 
+#include "calibration.h"
+#include "computeblur.h"
+#include "cpublur.h"
+#include "gputimer.h"
 #include "lshelper.h"
+#include "qualitygovernor.h"
+#include "texturepool.h"
+#include "tilemask.h"
 
 namespace KWin {
     class BlurManagerInterface;
@@ -23,11 +34,85 @@ namespace KWin {
 
 namespace Lightly {
 
+    /// The depth and offset of a blur pyramid, and the margin its kernel reaches beyond the blurred area
+    struct BlurKernel {
+        size_t iterationCount = 1;
+        float offset = 0.0f;
+        int expandSize = 0;
+
+        bool operator==(BlurKernel const& other) const = default;
+    };
+
     struct BlurRenderData {
-        /// Temporary render targets needed for the Dual Kawase algorithm, the first texture
-        /// contains not blurred background behind the window, it's cached.
-        std::vector<std::unique_ptr<KWin::GLTexture>> textures;
-        std::vector<std::unique_ptr<KWin::GLFramebuffer>> framebuffers;
+        /// Temporary render targets needed for the Dual Kawase algorithm, leased from the texture pool.
+        /// The first one contains not blurred background behind the window, it's cached.
+        std::vector<TextureLease> renderTargets;
+
+        /// Render targets of the upsample pass, upsampleRenderTargets[i] holds level i + 1. They are kept apart
+        /// from the downsampled levels so that a partial update can reuse both.
+        std::vector<TextureLease> upsampleRenderTargets;
+
+        /// The blurred background left in the first upsample level by the last blur, it can be reused
+        /// as long as nothing behind the window has been repainted.
+        bool blurValid = false;
+        QRect blurRect;
+
+        /// Whether the first render target holds the backdrop. It's left alone when the backdrop
+        /// is sampled straight from the render target.
+        bool backgroundValid = false;
+        qreal blurScale = 1.0;
+        BlurKernel blurKernel;
+
+        /// The presentation time of the frame the backdrop was last blurred in, for the refresh cap
+        std::chrono::milliseconds lastBlurTime {};
+
+        /// The geometry of the blur shape, uploaded again only when the shape, its position or the scale changes
+        std::unique_ptr<KWin::GLVertexBuffer> geometry;
+        QRegion geometryShape;
+        qreal geometryScale = 1.0;
+        int geometryVertexCount = 0;
+
+        /// The blur shape rasterized in device pixels, only set if the shape has too many rects for a quad each
+        std::unique_ptr<KWin::GLTexture> mask;
+
+        /// Damage behind the window since the last blur, collected in prePaintWindow
+        QRegion backdropDamage;
+        quint64 lastPrePaintFrame = 0;
+    };
+
+    /// The backdrop as it's read from the texture of the render target by the first downsample pass,
+    /// in place of a copy in the first level of the pyramid
+    struct BackdropView {
+        KWin::GLTexture* texture = nullptr;
+        QVector2D textureScale;
+        QVector2D textureOffset;
+        QVector4D textureBounds;
+        QVector2D halfpixel;
+    };
+
+    /// Windows whose backdrops aren't touched by anything painted in between can share one blur of
+    /// the union of their blur areas, grouped bottom to top in prePaintWindow.
+    struct SharedBlur {
+        QRect rect;
+        int members = 0;
+        BlurKernel kernel;
+
+        /// The area the members would blur on their own in this frame
+        qint64 separateCost = 0;
+
+        bool rendered = false;
+        bool failed = false;
+        BlurRenderData render;
+    };
+
+    /// The blur of a desktop window drawn on its own, kept until the desktop changes. Windows that have
+    /// nothing but the desktop behind them sample it instead of blurring their backdrop.
+    struct DesktopBlur {
+        SharedBlur blur;
+        bool valid = false;
+
+        /// Started when the desktop is damaged, a desktop that keeps changing isn't worth keeping a blur of
+        QElapsedTimer damaged;
     };
 
     struct BlurEffectData {
@@ -41,10 +126,23 @@ namespace Lightly {
         std::unordered_map<KWin::Output*, BlurRenderData> render;
 
         KWin::ItemEffect windowEffect;
+
+        /// Index of the shared blur the window belongs to in the current frame
+        int sharedBlur = -1;
+
+        /// The desktop window that is the only thing behind the window in the current frame
+        KWin::EffectWindow* desktop = nullptr;
+
+        /// The blur strength asked for by the client or a window rule, 0 for the configured one
+        int strength = 0;
+
+        /// Hash of content, frame and strength, updates that don't change them are dropped
+        size_t regionHash = 0;
     };
 
     class BlurEffect : public KWin::Effect {
         Q_OBJECT
+        Q_CLASSINFO("D-Bus Interface", "org.kde.lightlyshaders.blur")
 
     public:
         BlurEffect();
@@ -70,35 +168,84 @@ namespace Lightly {
 
         bool blocksDirectScanout() const override;
 
+        QString debug(QString const& parameter) const override;
+
     public Q_SLOTS:
         void slotWindowAdded(KWin::EffectWindow* w);
         void slotWindowDeleted(KWin::EffectWindow* w);
         void slotScreenRemoved(KWin::Output* screen);
+        void slotWindowVisibilityChanged(KWin::EffectWindow* w);
+        void slotDesktopChanged(KWin::EffectWindow* w);
 #if KWIN_BUILD_X11
         void slotPropertyNotify(KWin::EffectWindow* w, long atom);
 #endif
+
+        /// Times the ways to render every strength step and keeps the fastest ones, see StrengthCalibration
+        Q_SCRIPTABLE void calibrateStrengths();
         void setupDecorationConnections(KWin::EffectWindow* w);
 
     private:
+        bool initOpenGL();
         void initBlurStrengthValues();
+        double offsetForRadius(int iteration, double radius) const;
+        std::vector<StrengthCalibration::Candidate> calibrationCandidates() const;
+        QString calibrationPipeline() const;
+        void loadCalibration();
+        void applyCalibration(QList<StrengthCalibration::Choice> const& choices);
+        void applyQualityLevel();
+        BlurKernel kernel(int strength) const;
+        BlurKernel kernelFor(BlurEffectData const& blurInfo) const;
+        int windowStrength(KWin::EffectWindow* window) const;
         QRegion blurRegion(KWin::EffectWindow* window) const;
         QRegion decorationBlurRegion(KWin::EffectWindow const* window) const;
         bool decorationSupportsBlurBehind(KWin::EffectWindow const* window) const;
         bool shouldBlur(KWin::EffectWindow const* window, int mask, KWin::WindowPaintData const& data) const;
         void updateBlurRegion(KWin::EffectWindow* window);
+        void scheduleBlurRegionUpdate(KWin::EffectWindow* window);
+        void processBlurRegionUpdates();
         void blur(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, KWin::EffectWindow* w, int mask, QRegion const& region, KWin::WindowPaintData& data);
-        KWin::GLTexture* ensureNoiseTexture();
+        void discardCachedBlur(QRegion const& area);
+        bool allocateRenderTargets(BlurRenderData& renderInfo, BlurKernel const& kernel, GLenum format, GLenum outputFormat, QSize const& size);
+        GLenum intermediateFormat(GLenum outputFormat) const;
+        void releaseIdleRenderTargets();
+        void renderPyramid(KWin::GLVertexBuffer* vbo, BlurRenderData& renderInfo, BlurKernel const& kernel, QSize const& logicalSize, std::vector<QRegion> const* downsampleDamage, std::vector<QRegion> const* upsampleDamage, BackdropView const* backdrop);
+        bool renderPyramidCompute(BlurRenderData& renderInfo, BlurKernel const& kernel, QSize const& logicalSize, std::vector<QRegion> const* downsampleDamage, std::vector<QRegion> const* upsampleDamage);
+        bool backdropView(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, QRect const& rect, BackdropView* view) const;
+        void blurSoftware(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, BlurKernel const& kernel, QRegion const& blurShape, LSHelper::CornerShape const* corners, qreal opacity, QRegion const& paintRegion);
+        bool updateGeometry(BlurRenderData& renderInfo, QRegion const& blurShape, qreal scale, bool allowMask);
+        bool updateMask(BlurRenderData& renderInfo, QRegion const& blurShape, qreal scale, QSize const& size);
+        SharedBlur* sharedBlurFor(BlurEffectData const& blurInfo, QRect const& backgroundRect);
+        bool renderSharedBlur(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, QRegion const& region, SharedBlur& shared, GLenum format, GLenum outputFormat);
+        bool renderSharedPyramid(SharedBlur& shared, BackdropView const* backdrop);
+        bool desktopBlurCurrent(KWin::EffectWindow* desktop, DesktopBlur const& desktopBlur, GLenum outputFormat) const;
+        SharedBlur* desktopBlurFor(BlurEffectData const& blurInfo, BlurKernel const& kernel, QRect const& backgroundRect, GLenum outputFormat);
+        void updateDesktopBlur(KWin::RenderTarget const& renderTarget, KWin::EffectWindow* desktop);
+        bool renderDesktopBlur(KWin::EffectWindow* desktop, DesktopBlur& desktopBlur, QRect const& area, GLenum format, GLenum outputFormat);
+        void deferBlur(QRect const& area, std::chrono::nanoseconds due);
 
     private:
         LSHelper* m_helper;
 
-        struct
-        {
+        /// A downsample or upsample pass of the pyramid
+        struct SamplingPass {
             std::unique_ptr<KWin::GLShader> shader;
             int mvpMatrixLocation;
             int offsetLocation;
             int halfpixelLocation;
-        } m_downsamplePass;
+            int textureScaleLocation;
+            int textureOffsetLocation;
+            int textureBoundsLocation;
+            int tapSpreadLocation; // only in the reduced passes
+        };
+
+        static bool loadSamplingPass(SamplingPass& pass, QString const& fragmentShader);
+
+        SamplingPass m_downsamplePass;
+        SamplingPass m_upsamplePass;
+
+        /// The passes with four taps each, used if reduced taps are configured and they could be loaded
+        SamplingPass m_reducedDownsamplePass;
+        SamplingPass m_reducedUpsamplePass;
 
         struct
         {
@@ -106,37 +253,58 @@ namespace Lightly {
             int mvpMatrixLocation;
             int offsetLocation;
             int halfpixelLocation;
-        } m_upsamplePass;
-
-        struct
-        {
-            std::unique_ptr<KWin::GLShader> shader;
-            int mvpMatrixLocation;
-            int noiseTextureSizeLocation;
-            int texStartPosLocation;
-
-            std::unique_ptr<KWin::GLTexture> noiseTexture;
-            qreal noiseTextureScale = 1.0;
-            int noiseTextureStength = 0;
-        } m_noisePass;
+            int textureScaleLocation;
+            int textureOffsetLocation;
+            int textureBoundsLocation;
+            int noiseStrengthLocation;
+            int noiseScaleLocation;
+            int opacityLocation;
+            int cornerRectLocation;
+            int cornerRadiusLocation;
+            int cornerExponentLocation;
+            int maskUnitLocation;
+            int maskRectLocation;
+            int maskEnabledLocation;
+        } m_finalPass;
 
         bool m_valid = false;
 #if KWIN_BUILD_X11
         long net_wm_blur_region = 0;
+        long net_wm_blur_strength = 0;
 #endif
-        QRegion m_paintedArea; // keeps track of all painted areas (from bottom to top)
-        QRegion m_currentBlur; // keeps track of the currently blured area of the windows(from bottom to top)
+        BandRegion m_transformedShape; // scratch space for the shape of scaled windows
+        TileMask m_paintedArea; // keeps track of all painted areas (from bottom to top)
+        TileMask m_currentBlur; // keeps track of the currently blured area of the windows(from bottom to top)
+        std::vector<std::pair<QRect, int>> m_blurMargins; // the blurred areas of this frame and how far their kernels reach
         KWin::Output* m_currentScreen = nullptr;
-
-        size_t m_iterationCount; // number of times the texture will be downsized to half size
-        int m_offset;
-        int m_expandSize;
+        QRect m_screenArea;
+        std::unordered_map<KWin::Output*, quint64> m_screenFrames;
+        quint64 m_currentFrame = 0;
+        std::chrono::milliseconds m_presentTime {};
+        TileMask m_sharedBlurCover; // everything painted since the last shared blur started
+        TileMask m_desktopCover; // everything painted above the desktop windows
+        std::vector<std::pair<KWin::EffectWindow*, QRect>> m_desktopAreas; // untransformed desktops painted in this frame
+        std::unordered_set<KWin::EffectWindow*> m_sampledDesktops; // desktops whose blur windows above sample in this frame
+        std::unordered_set<KWin::EffectWindow*> m_pendingRegionUpdates; // decoded once per frame in prePaintScreen
+        std::vector<uchar> m_maskPixels; // scratch space for the shape masks
+
+        BlurKernel m_kernel; // the kernel of the configured strength at the quality level of the governor
+        int m_blurStrength = 1; // the configured strength, windows may ask for their own
+        QHash<QString, int> m_classStrengths; // window rules, the strength of windows by their class
         int m_noiseStrength;
+        bool m_blurTransformedWindows = false;
+        bool m_reducedTaps = false;
+        bool m_logicalResolutionBlur = true; // the CPU blur works in logical pixels on scaled outputs
+        int m_intermediateFormat = 0; // BlurConfig::EnumIntermediateFormat
+        std::chrono::nanoseconds m_refreshInterval {}; // zero blurs a changing backdrop in every frame
+        QRegion m_deferredBlurArea; // backdrops whose blur was held back by the refresh cap, repainted by the timer
+        QTimer m_deferredBlurTimer;
+        GLenum m_lastIntermediateFormat = GL_RGBA8;
 
         struct OffsetStruct {
             float minOffset;
             float maxOffset;
-            int expandSize;
+            int expandSize = 0;
         };
 
         QList<OffsetStruct> blurOffsets;
@@ -147,9 +315,64 @@ namespace Lightly {
         };
 
         QList<BlurValuesStruct> blurStrengthValues;
+        QList<BlurValuesStruct> m_defaultStrengthValues; // the strength table before the calibration
+        QList<double> m_strengthRadii; // the blur radius of every strength step, in pixels
+
+        std::unique_ptr<StrengthCalibration> m_calibration; // only set if the GPU time can be measured
+        QString m_calibrationPipeline; // the pipeline the strength table was loaded for
+        QTimer m_calibrationTimer; // starts the calibration of a pipeline without a stored table
+        // The widest output format blurred so far, the calibration measures the pipeline of its outputs
+        GLenum m_outputFormat = GL_RGBA8;
+        GLenum m_calibrationFormat = GL_RGBA8; // the formats of the pyramids of the current calibration run
+        GLenum m_calibrationOutputFormat = GL_RGBA8;
+
+        std::unique_ptr<ComputeBlur> m_computeBlur; // only set if compute shaders are enabled and supported
+        std::unique_ptr<CpuBlur> m_cpuBlur; // only set without OpenGL compositing
+        std::unique_ptr<GPUTimer> m_pyramidTimer;
+        QualityGovernor m_governor;
+        std::chrono::nanoseconds m_frameBlurTime {}; // GPU time of the blur passes collected since the last frame
+
+        struct
+        {
+            quint64 blurs = 0;
+            quint64 reused = 0;
+            quint64 partial = 0;
+            quint64 deferred = 0;
+            quint64 shared = 0;
+            quint64 sharedWindows = 0;
+            quint64 desktopBlurs = 0;
+            quint64 desktopWindows = 0;
+            quint64 geometryUploads = 0;
+            quint64 quads = 0;
+            quint64 maskUploads = 0;
+            quint64 frozenReused = 0;
+            quint64 frozenCaptures = 0;
+            quint64 uploadedBytes = 0;
+            quint64 backdropViews = 0;
+            quint64 backdropCopiedBytes = 0;
+            quint64 backdropSavedBytes = 0;
+            quint64 frames = 0;
+            std::chrono::nanoseconds cpuTime {};
+            quint64 timedPyramids = 0;
+            std::chrono::nanoseconds pyramidTime {};
+            quint64 softwareBlurs = 0;
+            std::chrono::nanoseconds softwareBlurTime {};
+            quint64 prePaintWindows = 0;
+            std::chrono::nanoseconds prePaintTime {};
+            quint64 regionUpdatesReceived = 0;
+            quint64 regionUpdatesProcessed = 0;
+            quint64 regionUpdatesDropped = 0;
+        } m_statistics;
+
+        // Declared before everything holding leases, they are given back on destruction
+        TexturePool m_texturePool;
+
+        std::vector<SharedBlur> m_sharedBlurs; // the shared blurs of the current frame
+        SharedBlur m_calibrationBlur; // the pyramid timed by the calibration
 
         QMap<KWin::EffectWindow*, QMetaObject::Connection> windowBlurChangedConnections;
         std::unordered_map<KWin::EffectWindow*, BlurEffectData> m_windows;
+        std::unordered_map<KWin::EffectWindow*, std::unordered_map<KWin::Output*, DesktopBlur>> m_desktopBlurs;
 
         static KWin::BlurManagerInterface* s_blurManager;
         static QTimer* s_blurManagerRemoveTimer;
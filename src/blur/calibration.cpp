@@ -0,0 +1,210 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "calibration.h"
+
+#include "effect/effecthandler.h"
+
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+Q_DECLARE_LOGGING_CATEGORY(KWIN_BLUR)
+
+namespace Lightly {
+
+    // Every candidate is timed this many times, the median counts
+    static constexpr size_t s_samples = 9;
+    // Pyramids rendered per tick, and measurements left waiting for the GPU at most. The GPU timer has 16 slots.
+    static constexpr int s_runsPerStep = 4;
+    static constexpr size_t s_maxPending = 8;
+    static constexpr int s_stepInterval = 50; // ms
+
+    static QString cacheFile()
+    {
+        return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/lightlyshaders/blurcalibration");
+    }
+
+    StrengthCalibration::StrengthCalibration(RenderFunction render, FinishedFunction finished)
+        : m_render(std::move(render))
+        , m_finished(std::move(finished))
+    {
+        m_stepTimer.setInterval(s_stepInterval);
+        m_stepTimer.callOnTimeout([this]() {
+            step();
+        });
+    }
+
+    QString StrengthCalibration::renderer()
+    {
+        auto const renderer = reinterpret_cast<char const*>(glGetString(GL_RENDERER));
+        auto const version = reinterpret_cast<char const*>(glGetString(GL_VERSION));
+        if (!renderer || !version) {
+            return QString();
+        }
+        return QString::fromUtf8(renderer) + QLatin1Char(' ') + QString::fromUtf8(version);
+    }
+
+    QList<StrengthCalibration::Choice> StrengthCalibration::load(QString const& pipeline, int strengthCount) const
+    {
+        QString const name = renderer();
+        if (name.isEmpty()) {
+            return {};
+        }
+
+        KConfig config(cacheFile(), KConfig::SimpleConfig);
+        KConfigGroup const group = KConfigGroup(&config, name).group(pipeline);
+        QList<int> const iterations = group.readEntry("Iterations", QList<int>());
+        QList<double> const offsets = group.readEntry("Offsets", QList<double>());
+        if (iterations.size() != strengthCount || offsets.size() != strengthCount) {
+            return {};
+        }
+
+        QList<Choice> choices;
+        for (int i = 0; i < strengthCount; ++i) {
+            choices.append(Choice { iterations[i], float(offsets[i]) });
+        }
+        return choices;
+    }
+
+    void StrengthCalibration::save(QList<Choice> const& choices) const
+    {
+        QString const path = cacheFile();
+        if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+            qCWarning(KWIN_BLUR) << "Failed to create the directory of" << path;
+            return;
+        }
+
+        QList<int> iterations;
+        QList<double> offsets;
+        for (Choice const& choice : choices) {
+            iterations.append(choice.iteration);
+            offsets.append(choice.offset);
+        }
+
+        KConfig config(path, KConfig::SimpleConfig);
+        KConfigGroup group = KConfigGroup(&config, renderer()).group(m_pipeline);
+        group.writeEntry("Iterations", iterations);
+        group.writeEntry("Offsets", offsets);
+        if (!config.sync()) {
+            qCWarning(KWIN_BLUR) << "Failed to store the blur calibration in" << path;
+        }
+    }
+
+    void StrengthCalibration::start(QString const& pipeline, std::vector<Candidate> candidates)
+    {
+        if (isRunning() || candidates.empty()) {
+            return;
+        }
+
+        KWin::effects->makeOpenGLContextCurrent();
+        if (!GPUTimer::supported()) {
+            qCWarning(KWIN_BLUR) << "The blur can't be calibrated without GPU timer queries";
+            return;
+        }
+
+        m_timer = std::make_unique<GPUTimer>();
+        m_pipeline = pipeline;
+        m_candidates = std::move(candidates);
+        m_timings.assign(m_candidates.size(), {});
+        m_pending.clear();
+        m_nextRun = 0;
+        m_runCount = m_candidates.size() * s_samples;
+        m_finishedRuns = 0;
+        m_stepTimer.start();
+    }
+
+    void StrengthCalibration::cancel()
+    {
+        // The pyramids still waiting for the GPU are dropped with the timer
+        KWin::effects->makeOpenGLContextCurrent();
+        m_stepTimer.stop();
+        m_timer.reset();
+        m_pending.clear();
+    }
+
+    bool StrengthCalibration::isRunning() const
+    {
+        return m_stepTimer.isActive();
+    }
+
+    QString StrengthCalibration::pipeline() const
+    {
+        return m_pipeline;
+    }
+
+    qreal StrengthCalibration::progress() const
+    {
+        return m_runCount ? qreal(m_finishedRuns) / m_runCount : 0.0;
+    }
+
+    void StrengthCalibration::step()
+    {
+        KWin::effects->makeOpenGLContextCurrent();
+
+        while (!m_pending.empty()) {
+            auto const time = m_timer->result();
+            if (!time) {
+                break;
+            }
+            m_timings[m_pending.front()].push_back(*time);
+            m_pending.pop_front();
+            ++m_finishedRuns;
+        }
+
+        for (int i = 0; i < s_runsPerStep && m_nextRun < m_runCount && m_pending.size() < s_maxPending; ++i) {
+            size_t const candidate = m_nextRun % m_candidates.size();
+            if (!m_render(m_candidates[candidate].choice, m_timer)) {
+                qCWarning(KWIN_BLUR) << "Failed to render a pyramid for the blur calibration";
+                m_stepTimer.stop();
+                m_timer.reset();
+                return;
+            }
+            m_pending.push_back(candidate);
+            ++m_nextRun;
+        }
+
+        if (m_finishedRuns == m_runCount) {
+            finish();
+        }
+    }
+
+    void StrengthCalibration::finish()
+    {
+        m_stepTimer.stop();
+        m_timer.reset();
+
+        // The median of every candidate, the fastest one of every strength step wins
+        std::vector<std::chrono::nanoseconds> medians;
+        for (auto& timings : m_timings) {
+            std::nth_element(timings.begin(), timings.begin() + timings.size() / 2, timings.end());
+            medians.push_back(timings[timings.size() / 2]);
+        }
+
+        QList<Choice> choices;
+        std::vector<std::chrono::nanoseconds> fastest;
+        for (size_t i = 0; i < m_candidates.size(); ++i) {
+            int const step = m_candidates[i].strength - 1;
+            if (step >= choices.size()) {
+                choices.resize(step + 1, m_candidates[i].choice);
+                fastest.resize(step + 1, medians[i]);
+            } else if (medians[i] < fastest[step]) {
+                choices[step] = m_candidates[i].choice;
+                fastest[step] = medians[i];
+            }
+        }
+
+        save(choices);
+        m_finished(choices);
+    }
+
+} // namespace Lightly
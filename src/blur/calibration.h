@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QTimer>
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "gputimer.h"
+
+namespace Lightly {
+
+    /// Times the pyramid depths and offsets that give the same blur radius for every strength step on the GPU
+    /// and keeps the fastest ones per renderer and pipeline in the cache directory. A run renders a few pyramids per timer
+    /// tick, outside of the painting, and collects the timings once the GPU has them.
+    class StrengthCalibration {
+    public:
+        /// A way to render a strength step, the depth and offset of its pyramid
+        struct Choice {
+            int iteration;
+            float offset;
+        };
+
+        struct Candidate {
+            int strength; // starts at 1
+            Choice choice;
+        };
+
+        /// Renders one pyramid of the given depth and offset, measured by the timer
+        using RenderFunction = std::function<bool(Choice const& choice, std::unique_ptr<GPUTimer>& timer)>;
+        /// Called with the fastest choice for every strength step once a run is complete
+        using FinishedFunction = std::function<void(QList<Choice> const& choices)>;
+
+        StrengthCalibration(RenderFunction render, FinishedFunction finished);
+
+        /// The renderer the timings are stored for, made of the GL renderer and version strings
+        static QString renderer();
+
+        /// The choices stored for the renderer and the pipeline, empty if they weren't calibrated yet.
+        /// The pipeline names everything the timings depend on besides the renderer.
+        QList<Choice> load(QString const& pipeline, int strengthCount) const;
+
+        void start(QString const& pipeline, std::vector<Candidate> candidates);
+        void cancel();
+        bool isRunning() const;
+
+        /// The pipeline of the current or the last run
+        QString pipeline() const;
+
+        /// The share of the measurements of the current run that have finished
+        qreal progress() const;
+
+    private:
+        void step();
+        void finish();
+        void save(QList<Choice> const& choices) const;
+
+        RenderFunction m_render;
+        FinishedFunction m_finished;
+        std::unique_ptr<GPUTimer> m_timer;
+        QTimer m_stepTimer;
+        QString m_pipeline;
+
+        std::vector<Candidate> m_candidates;
+        std::vector<std::vector<std::chrono::nanoseconds>> m_timings; // per candidate
+        std::deque<size_t> m_pending; // the candidates of the measurements the GPU hasn't finished, oldest first
+        size_t m_nextRun = 0; // the runs go through the candidates in turns, every one is measured several times
+        size_t m_runCount = 0;
+        size_t m_finishedRuns = 0;
+    };
+
+} // namespace Lightly
@@ -0,0 +1,167 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "computeblur.h"
+#include "texturepool.h"
+
+#include <QFile>
+#include <QLoggingCategory>
+
+#include <algorithm>
+
+Q_DECLARE_LOGGING_CATEGORY(KWIN_BLUR)
+
+namespace Lightly {
+
+    static int const s_localSize[] = { 8, 16 };
+
+    static char const* imageFormat(GLenum format)
+    {
+        switch (format) {
+        case GL_RGBA8:
+            return "rgba8";
+        case GL_RGB10_A2:
+            return "rgb10_a2";
+        case GL_RGBA16F:
+            return "rgba16f";
+        case GL_RGBA32F:
+            return "rgba32f";
+        case GL_R11F_G11F_B10F:
+            return "r11f_g11f_b10f";
+        default:
+            return nullptr;
+        }
+    }
+
+    static GLuint compileProgram(QByteArray const& source)
+    {
+        GLuint const shader = glCreateShader(GL_COMPUTE_SHADER);
+        char const* sourceData = source.constData();
+        glShaderSource(shader, 1, &sourceData, nullptr);
+        glCompileShader(shader);
+
+        GLint status = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE) {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            QByteArray log(std::max(length, 1), '\0');
+            glGetShaderInfoLog(shader, log.size(), nullptr, log.data());
+            qCWarning(KWIN_BLUR) << "Failed to compile blur compute shader:" << log.constData();
+            glDeleteShader(shader);
+            return 0;
+        }
+
+        GLuint const program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        glDeleteShader(shader);
+
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE) {
+            qCWarning(KWIN_BLUR) << "Failed to link blur compute shader";
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    ComputeBlur::~ComputeBlur()
+    {
+        for (auto const& [key, program] : m_programs) {
+            if (program.program) {
+                glDeleteProgram(program.program);
+            }
+        }
+    }
+
+    bool ComputeBlur::supported()
+    {
+        return epoxy_is_desktop_gl() && (epoxy_gl_version() >= 43 || (epoxy_has_gl_extension("GL_ARB_compute_shader") && epoxy_has_gl_extension("GL_ARB_shader_image_load_store")));
+    }
+
+    bool ComputeBlur::supportsFormat(GLenum format)
+    {
+        return imageFormat(format) != nullptr;
+    }
+
+    ComputeBlur::Program const& ComputeBlur::program(Pass pass, GLenum format)
+    {
+        auto const key = std::make_pair(pass, format);
+        if (auto it = m_programs.find(key); it != m_programs.end()) {
+            return it->second;
+        }
+
+        // A failed compilation is remembered as well, so it isn't retried every frame
+        Program& program = m_programs[key];
+
+        QFile file(QStringLiteral(":/effects/blur/shaders/blur.comp"));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCWarning(KWIN_BLUR) << "Failed to read blur compute shader";
+            return program;
+        }
+
+        QByteArray source = QByteArrayLiteral("#version 430\n");
+        source += QByteArrayLiteral("#define OUTPUT_FORMAT ") + imageFormat(format) + '\n';
+        source += QByteArrayLiteral("#define LOCAL_SIZE ") + QByteArray::number(s_localSize[int(pass)]) + '\n';
+        if (pass == Pass::Upsample) {
+            source += QByteArrayLiteral("#define UPSAMPLE\n");
+        }
+        source += file.readAll();
+
+        program.program = compileProgram(source);
+        if (program.program) {
+            program.sourceSizeLocation = glGetUniformLocation(program.program, "sourceSize");
+            program.destinationSizeLocation = glGetUniformLocation(program.program, "destinationSize");
+            program.destinationOriginLocation = glGetUniformLocation(program.program, "destinationOrigin");
+            program.offsetLocation = glGetUniformLocation(program.program, "offset");
+        }
+        return program;
+    }
+
+    bool ComputeBlur::dispatch(Pass pass, TextureLease const& read, TextureLease const& draw, QRect const& area, float offset)
+    {
+        GLenum const format = draw.texture()->internalFormat();
+        if (!supportsFormat(format)) {
+            return false;
+        }
+
+        Program const& p = program(pass, format);
+        if (!p.program) {
+            return false;
+        }
+        if (area.isEmpty()) {
+            return true;
+        }
+
+        glUseProgram(p.program);
+        glUniform2i(p.sourceSizeLocation, read.size().width(), read.size().height());
+        glUniform2i(p.destinationSizeLocation, draw.size().width(), draw.size().height());
+        glUniform2i(p.destinationOriginLocation, area.x(), area.y());
+        glUniform1f(p.offsetLocation, offset);
+
+        read.texture()->bind();
+        glBindImageTexture(0, draw.texture()->texture(), 0, GL_FALSE, 0, GL_WRITE_ONLY, format);
+
+        int const localSize = s_localSize[int(pass)];
+        glDispatchCompute((area.width() + localSize - 1) / localSize, (area.height() + localSize - 1) / localSize, 1);
+
+        // The next pass samples what has just been written. The pool hands the texture out again later,
+        // possibly as the target of a blit or a framebuffer, which must not overtake the image stores.
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+
+        glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, format);
+
+        // Give the program back to the shader manager, which still believes its shader to be bound
+        if (KWin::GLShader* shader = KWin::ShaderManager::instance()->getBoundShader()) {
+            shader->bind();
+        } else {
+            glUseProgram(0);
+        }
+        return true;
+    }
+
+} // namespace Lightly
@@ -0,0 +1,54 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <epoxy/gl.h>
+
+#include <QRect>
+
+#include <map>
+#include <utility>
+
+namespace Lightly {
+
+    class TextureLease;
+
+    /// Runs the Dual Kawase passes as compute shaders. Every work group loads the source texels it reads
+    /// into shared memory once instead of fetching them for every tap. Needs OpenGL 4.3.
+    class ComputeBlur {
+    public:
+        enum class Pass {
+            Downsample,
+            Upsample,
+        };
+
+        ComputeBlur() = default;
+        ~ComputeBlur();
+
+        static bool supported();
+
+        /// Image load/store only works with some formats, sRGB and three channel ones aren't among them
+        static bool supportsFormat(GLenum format);
+
+        /// Renders the area of the draw target, in texels with the origin at the bottom left corner
+        bool dispatch(Pass pass, TextureLease const& read, TextureLease const& draw, QRect const& area, float offset);
+
+    private:
+        struct Program {
+            GLuint program = 0;
+            int sourceSizeLocation = -1;
+            int destinationSizeLocation = -1;
+            int destinationOriginLocation = -1;
+            int offsetLocation = -1;
+        };
+
+        Program const& program(Pass pass, GLenum format);
+
+        std::map<std::pair<Pass, GLenum>, Program> m_programs;
+    };
+
+} // namespace Lightly
@@ -0,0 +1,359 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "cpublur.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <cmath>
+#include <latch>
+
+// The row kernels are plain loops over the channels the compiler vectorizes, built once more for AVX2
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#    define LIGHTLY_TARGET_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#    define LIGHTLY_TARGET_CLONES
+#endif
+
+namespace Lightly {
+
+    // Rows shorter than this aren't worth handing to another thread
+    static constexpr int s_minimumRowsPerBand = 32;
+    // The size of the repeated noise tile, a power of two
+    static constexpr int s_noiseTileSize = 256;
+
+    // A copy of the row with the edge pixels repeated pad times on both sides
+    static void padRow(uchar const* row, int width, int pad, std::vector<uchar>& padded)
+    {
+        padded.resize(size_t(width + 2 * pad) * 4);
+        std::copy(row, row + width * 4, padded.data() + pad * 4);
+        for (int i = 0; i < pad; ++i) {
+            std::copy(row, row + 4, padded.data() + i * 4);
+            std::copy(row + (width - 1) * 4, row + width * 4, padded.data() + (pad + width + i) * 4);
+        }
+    }
+
+    // The sum of two rows, which are padded the same way
+    LIGHTLY_TARGET_CLONES
+    static void addRows(uchar const* first, uchar const* second, int count, quint16* sum)
+    {
+        for (int i = 0; i < count; ++i) {
+            sum[i] = quint16(first[i]) + second[i];
+        }
+    }
+
+    // A row of the downsample pass. The rows are vertical sums of pixel pairs at the center of the kernel and
+    // at its lower and upper diagonal taps, padded by pad pixels. The center is weighted four times like the
+    // center tap of the shader and every tap is the average of the 2x2 pixels around a pixel corner.
+    LIGHTLY_TARGET_CLONES
+    static void downsampleRow(quint16 const* center, quint16 const* lower, quint16 const* upper, int pad, int offset, int width, uchar* draw)
+    {
+        for (int x = 0; x < width; ++x) {
+            // The pixels left and right of the corner
+            int const p = (pad + 2 * x) * 4;
+            int const left = p - offset * 4;
+            int const right = p + offset * 4;
+            for (int c = 0; c < 4; ++c) {
+                quint32 const sum = 4 * (center[p + c] + center[p + 4 + c])
+                    + lower[left + c] + lower[left + 4 + c] + lower[right + c] + lower[right + 4 + c]
+                    + upper[left + c] + upper[left + 4 + c] + upper[right + c] + upper[right + 4 + c];
+                draw[x * 4 + c] = uchar((sum + 16) >> 5);
+            }
+        }
+    }
+
+    // A row of the upsample kernel: four axial taps at the offset and four diagonal taps of twice the weight
+    // at half the offset, read from padded rows
+    LIGHTLY_TARGET_CLONES
+    static void upsampleKernelRow(uchar const* row, uchar const* above, uchar const* below, uchar const* diagonalAbove, uchar const* diagonalBelow,
+                                  int pad, int offset, int diagonalOffset, int width, uchar* draw)
+    {
+        for (int i = 0; i < width * 4; ++i) {
+            int const p = pad * 4 + i;
+            quint32 const sum = row[p - offset * 4] + row[p + offset * 4] + above[p] + below[p]
+                + 2 * (diagonalAbove[p - diagonalOffset * 4] + diagonalAbove[p + diagonalOffset * 4] + diagonalBelow[p - diagonalOffset * 4] + diagonalBelow[p + diagonalOffset * 4]);
+            draw[i] = uchar((sum + 6) / 12);
+        }
+    }
+
+    // Blends two rows vertically, the weight of the second row is given in 1/256
+    LIGHTLY_TARGET_CLONES
+    static void blendRows(uchar const* first, uchar const* second, int weight, int count, quint16* blended)
+    {
+        for (int i = 0; i < count; ++i) {
+            blended[i] = quint16(first[i] * (256 - weight) + second[i] * weight);
+        }
+    }
+
+    // Scales a vertically blended row horizontally, every pixel of the result blends two columns
+    static void scaleRow(quint16 const* row, int const* columns, int const* weights, int width, uchar* draw)
+    {
+        for (int x = 0; x < width; ++x) {
+            int const left = columns[x] * 4;
+            int const right = columns[x + width] * 4;
+            int const weight = weights[x];
+            for (int c = 0; c < 4; ++c) {
+                draw[x * 4 + c] = uchar((row[left + c] * quint32(256 - weight) + row[right + c] * quint32(weight) + (1 << 15)) >> 16);
+            }
+        }
+    }
+
+    // The texel of the source a texel of the scaled image samples, like linear filtering does
+    static void sourceTexels(int texel, int drawSize, int readSize, int* first, int* second, int* weight)
+    {
+        qreal const position = std::max(0.0, (texel + 0.5) * readSize / drawSize - 0.5);
+        *first = std::min(int(position), readSize - 1);
+        *second = std::min(*first + 1, readSize - 1);
+        *weight = int(std::round((position - int(position)) * 256));
+    }
+
+    CpuBlur::CpuBlur()
+    {
+        setThreadCount(0);
+    }
+
+    CpuBlur::~CpuBlur()
+    {
+        m_threadPool.waitForDone();
+    }
+
+    void CpuBlur::setThreadCount(int count)
+    {
+        m_threadCount = count > 0 ? count : std::clamp(QThread::idealThreadCount(), 1, 4);
+        // The calling thread takes a band too
+        m_threadPool.setMaxThreadCount(std::max(1, m_threadCount - 1));
+    }
+
+    int CpuBlur::threadCount() const
+    {
+        return m_threadCount;
+    }
+
+    void CpuBlur::forEachRowBand(int rows, std::function<void(int first, int last)> const& function)
+    {
+        int const bands = std::clamp(rows / s_minimumRowsPerBand, 1, m_threadCount);
+        if (bands == 1) {
+            function(0, rows);
+            return;
+        }
+
+        std::latch done(bands - 1);
+        for (int band = 1; band < bands; ++band) {
+            m_threadPool.start([&, band]() {
+                function(rows * band / bands, rows * (band + 1) / bands);
+                done.count_down();
+            });
+        }
+        function(0, rows / bands);
+        done.wait();
+    }
+
+    void CpuBlur::downsample(QImage const& read, QImage& draw, int offset)
+    {
+        int const pad = offset + 1;
+        int const readWidth = read.width();
+        int const readHeight = read.height();
+
+        forEachRowBand(draw.height(), [&](int first, int last) {
+            std::vector<uchar> top;
+            std::vector<uchar> bottom;
+            std::vector<quint16> rows[3];
+            for (int y = first; y < last; ++y) {
+                // The rows above and below the pixel corner at the center and at the diagonal taps
+                int const corners[3] = {2 * y + 1, 2 * y + 1 + offset, 2 * y + 1 - offset};
+                for (int i = 0; i < 3; ++i) {
+                    padRow(read.constScanLine(std::clamp(corners[i] - 1, 0, readHeight - 1)), readWidth, pad, top);
+                    padRow(read.constScanLine(std::clamp(corners[i], 0, readHeight - 1)), readWidth, pad, bottom);
+                    rows[i].resize(top.size());
+                    addRows(top.data(), bottom.data(), int(top.size()), rows[i].data());
+                }
+                downsampleRow(rows[0].data(), rows[1].data(), rows[2].data(), pad, offset, draw.width(), draw.scanLine(y));
+            }
+        });
+    }
+
+    void CpuBlur::upsample(QImage const& read, QImage& kernel, QImage& draw, int offset)
+    {
+        // The kernel is applied at the resolution of the read level, then scaled up linearly
+        int const diagonalOffset = (offset + 1) / 2;
+        int const pad = offset;
+        int const readHeight = read.height();
+
+        forEachRowBand(read.height(), [&](int first, int last) {
+            std::vector<uchar> rows[5];
+            for (int y = first; y < last; ++y) {
+                int const sources[5] = {y, y - offset, y + offset, y - diagonalOffset, y + diagonalOffset};
+                for (int i = 0; i < 5; ++i) {
+                    padRow(read.constScanLine(std::clamp(sources[i], 0, readHeight - 1)), read.width(), pad, rows[i]);
+                }
+                upsampleKernelRow(rows[0].data(), rows[1].data(), rows[2].data(), rows[3].data(), rows[4].data(),
+                                  pad, offset, diagonalOffset, read.width(), kernel.scanLine(y));
+            }
+        });
+
+        scale(kernel, kernel.rect(), draw);
+    }
+
+    void CpuBlur::scale(QImage const& read, QRect const& area, QImage& draw)
+    {
+        int const width = draw.width();
+        std::vector<int> columns(width * 2);
+        std::vector<int> weights(width);
+        for (int x = 0; x < width; ++x) {
+            sourceTexels(x, width, area.width(), &columns[x], &columns[x + width], &weights[x]);
+        }
+
+        forEachRowBand(draw.height(), [&](int first, int last) {
+            std::vector<quint16> row(area.width() * 4);
+            for (int y = first; y < last; ++y) {
+                int top;
+                int bottom;
+                int weight;
+                sourceTexels(y, draw.height(), area.height(), &top, &bottom, &weight);
+                blendRows(read.constScanLine(area.y() + top) + area.x() * 4, read.constScanLine(area.y() + bottom) + area.x() * 4, weight, int(row.size()), row.data());
+                scaleRow(row.data(), columns.data(), weights.data(), width, draw.scanLine(y));
+            }
+        });
+    }
+
+    void CpuBlur::blur(QImage const& source, QRect const& rect, QSize const& size, int iterations, float offset)
+    {
+        QRect const area = rect & source.rect();
+        if (area.isEmpty() || size.isEmpty()) {
+            m_levels.clear();
+            return;
+        }
+
+        // The levels are kept between blurs of the same size
+        m_levels.resize(iterations + 1);
+        m_kernels.resize(iterations);
+        for (int i = 0; i <= iterations; ++i) {
+            QSize const levelSize(std::max(1, size.width() >> i), std::max(1, size.height() >> i));
+            if (m_levels[i].size() != levelSize) {
+                m_levels[i] = QImage(levelSize, QImage::Format_ARGB32_Premultiplied);
+            }
+            if (i > 0 && m_kernels[i - 1].size() != levelSize) {
+                m_kernels[i - 1] = QImage(levelSize, QImage::Format_ARGB32_Premultiplied);
+            }
+        }
+
+        // RGB32 has the same layout, its unused alpha is always opaque
+        if (source.format() == QImage::Format_ARGB32_Premultiplied || source.format() == QImage::Format_RGB32) {
+            if (area.size() == size) {
+                for (int y = 0; y < area.height(); ++y) {
+                    uchar const* row = source.constScanLine(area.y() + y) + area.x() * 4;
+                    std::copy(row, row + area.width() * 4, m_levels[0].scanLine(y));
+                }
+            } else {
+                scale(source, area, m_levels[0]);
+            }
+        } else {
+            QImage const converted = source.copy(area).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+            scale(converted, converted.rect(), m_levels[0]);
+        }
+
+        // The offsets of the shaders in texels of the level they read, the downsample taps sit half as far out
+        int const downsampleOffset = int(std::round(offset / 2));
+        int const upsampleOffset = std::max(1, int(std::round(offset)));
+
+        for (int i = 1; i <= iterations; ++i) {
+            downsample(m_levels[i - 1], m_levels[i], downsampleOffset);
+        }
+        for (int i = iterations - 1; i >= 0; --i) {
+            upsample(m_levels[i + 1], m_kernels[i], m_levels[i], upsampleOffset);
+        }
+    }
+
+    // The same hash of the position as in the final pass shader
+    static float noise(float x, float y)
+    {
+        float p[3] = {x * 0.1031f, y * 0.1031f, x * 0.1031f};
+        for (float& value : p) {
+            value -= std::floor(value);
+        }
+        float const d = p[0] * (p[1] + 33.33f) + p[1] * (p[2] + 33.33f) + p[2] * (p[0] + 33.33f);
+        for (float& value : p) {
+            value += d;
+        }
+        float const n = (p[0] + p[1]) * p[2];
+        return n - std::floor(n);
+    }
+
+    void CpuBlur::addNoise(int strength, qreal scale, QPoint const& origin)
+    {
+        if (m_levels.empty() || strength <= 0) {
+            return;
+        }
+
+        // The hash is too slow to run for every pixel, it's evaluated once for a tile that repeats
+        if (m_noiseStrength != strength || m_noiseScale != scale) {
+            m_noiseStrength = strength;
+            m_noiseScale = scale;
+            m_noise.resize(s_noiseTileSize * s_noiseTileSize);
+            for (int y = 0; y < s_noiseTileSize; ++y) {
+                for (int x = 0; x < s_noiseTileSize; ++x) {
+                    m_noise[y * s_noiseTileSize + x] = uchar(noise(std::floor(x / scale), std::floor(y / scale)) * strength);
+                }
+            }
+        }
+
+        QImage& image = m_levels[0];
+        int constexpr mask = s_noiseTileSize - 1;
+        forEachRowBand(image.height(), [&](int first, int last) {
+            for (int y = first; y < last; ++y) {
+                QRgb* row = reinterpret_cast<QRgb*>(image.scanLine(y));
+                uchar const* noiseRow = m_noise.data() + ((origin.y() + y) & mask) * s_noiseTileSize;
+                for (int x = 0; x < image.width(); ++x) {
+                    int const value = noiseRow[(origin.x() + x) & mask];
+                    int const alpha = qAlpha(row[x]);
+                    row[x] = qRgba(std::min(qRed(row[x]) + value, alpha), std::min(qGreen(row[x]) + value, alpha), std::min(qBlue(row[x]) + value, alpha), alpha);
+                }
+            }
+        });
+    }
+
+    void CpuBlur::clipCorners(QRectF const& frame, qreal radius, qreal exponent)
+    {
+        if (m_levels.empty() || radius <= 0) {
+            return;
+        }
+
+        // Only the squares of the corners are touched, the coverage is the same as in the final pass shader
+        QImage& image = m_levels[0];
+        auto coverage = [&](qreal x, qreal y) {
+            qreal const dx = std::abs(x - std::clamp(x, frame.left() + radius, frame.right() - radius));
+            qreal const dy = std::abs(y - std::clamp(y, frame.top() + radius, frame.bottom() - radius));
+            qreal const distance = exponent > 0 ? std::pow(std::pow(dx, exponent) + std::pow(dy, exponent), 1.0 / exponent) : std::hypot(dx, dy);
+            return std::clamp(radius - distance + 0.5, 0.0, 1.0);
+        };
+
+        int const size = int(std::ceil(radius)) + 1;
+        QRect const corners[4] = {
+            QRect(std::floor(frame.left()), std::floor(frame.top()), size, size),
+            QRect(std::ceil(frame.right()) - size, std::floor(frame.top()), size, size),
+            QRect(std::floor(frame.left()), std::ceil(frame.bottom()) - size, size, size),
+            QRect(std::ceil(frame.right()) - size, std::ceil(frame.bottom()) - size, size, size),
+        };
+        for (QRect const& corner : corners) {
+            QRect const area = corner & image.rect();
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                QRgb* row = reinterpret_cast<QRgb*>(image.scanLine(y));
+                for (int x = area.left(); x <= area.right(); ++x) {
+                    int const alpha = int(std::round(coverage(x + 0.5, y + 0.5) * 256));
+                    row[x] = qRgba(qRed(row[x]) * alpha >> 8, qGreen(row[x]) * alpha >> 8, qBlue(row[x]) * alpha >> 8, qAlpha(row[x]) * alpha >> 8);
+                }
+            }
+        }
+    }
+
+    QImage const& CpuBlur::result() const
+    {
+        static QImage const empty;
+        return m_levels.empty() ? empty : m_levels[0];
+    }
+
+} // namespace Lightly
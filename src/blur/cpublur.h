@@ -0,0 +1,65 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QImage>
+#include <QThreadPool>
+
+#include <functional>
+#include <vector>
+
+namespace Lightly {
+
+    /// The Dual Kawase blur on the CPU, for the QPainter backend. The passes work on premultiplied ARGB32
+    /// images with the tap offsets rounded to whole pixels, and every pass splits its rows between a few
+    /// worker threads. The inner loops are also built for AVX2, the fastest supported version is picked at runtime.
+    class CpuBlur {
+    public:
+        CpuBlur();
+        ~CpuBlur();
+
+        /// Zero picks one thread per core, at most four
+        void setThreadCount(int count);
+        int threadCount() const;
+
+        /// Blurs the rect of the source, in pixels of the source, scaled linearly to the given size.
+        /// The result has that size.
+        void blur(QImage const& source, QRect const& rect, QSize const& size, int iterations, float offset);
+
+        /// Adds the dither of the final pass of the GPU blur, the origin is the position of the result in the source
+        void addNoise(int strength, qreal scale, QPoint const& origin);
+
+        /// Fades out the result outside of the rounded frame, the frame is given in pixels of the result.
+        /// A zero exponent means circular corners, otherwise the corners are superellipses with that exponent.
+        void clipCorners(QRectF const& frame, qreal radius, qreal exponent);
+
+        QImage const& result() const;
+
+    private:
+        /// Calls the function for bands of the rows, in parallel
+        void forEachRowBand(int rows, std::function<void(int first, int last)> const& function);
+
+        void downsample(QImage const& read, QImage& draw, int offset);
+        void upsample(QImage const& read, QImage& kernel, QImage& draw, int offset);
+
+        /// Scales the area of the image linearly into all of the draw image
+        void scale(QImage const& read, QRect const& area, QImage& draw);
+
+        int m_threadCount = 1;
+        QThreadPool m_threadPool;
+
+        /// Level i has 1/2^i of the size of the blurred rect, the first one ends up holding the result
+        std::vector<QImage> m_levels;
+        /// The upsample kernel applied to level i + 1, before it's scaled up into level i
+        std::vector<QImage> m_kernels;
+
+        std::vector<uchar> m_noise; // a tile of the dither, made for the strength and scale below
+        int m_noiseStrength = 0;
+        qreal m_noiseScale = 0;
+    };
+
+} // namespace Lightly
@@ -0,0 +1,83 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "gputimer.h"
+
+namespace Lightly {
+
+    GPUTimer::GPUTimer()
+    {
+        if (!supported()) {
+            return;
+        }
+
+        glGenQueries(m_queries.size(), m_queries.data());
+        m_valid = true;
+    }
+
+    GPUTimer::~GPUTimer()
+    {
+        if (m_valid) {
+            glDeleteQueries(m_queries.size(), m_queries.data());
+        }
+    }
+
+    bool GPUTimer::supported()
+    {
+        if (epoxy_is_desktop_gl()) {
+            return epoxy_gl_version() >= 33 || epoxy_has_gl_extension("GL_ARB_timer_query");
+        }
+        return epoxy_has_gl_extension("GL_EXT_disjoint_timer_query");
+    }
+
+    void GPUTimer::begin()
+    {
+        // Skip the measurement if all slots are still waiting for the GPU
+        m_running = m_valid && !m_pending[m_current];
+        if (!m_running) {
+            return;
+        }
+
+        glQueryCounter(m_queries[2 * m_current], GL_TIMESTAMP);
+    }
+
+    void GPUTimer::end()
+    {
+        if (!m_running) {
+            return;
+        }
+
+        glQueryCounter(m_queries[2 * m_current + 1], GL_TIMESTAMP);
+        m_pending[m_current] = true;
+        m_current = (m_current + 1) % s_slotCount;
+        m_running = false;
+    }
+
+    std::optional<std::chrono::nanoseconds> GPUTimer::result()
+    {
+        if (!m_valid || !m_pending[m_oldest]) {
+            return std::nullopt;
+        }
+
+        GLuint const endQuery = m_queries[2 * m_oldest + 1];
+        GLuint available = 0;
+        glGetQueryObjectuiv(endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return std::nullopt;
+        }
+
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(m_queries[2 * m_oldest], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &end);
+
+        m_pending[m_oldest] = false;
+        m_oldest = (m_oldest + 1) % s_slotCount;
+
+        return std::chrono::nanoseconds(end > start ? end - start : 0);
+    }
+
+} // namespace Lightly
@@ -0,0 +1,43 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <epoxy/gl.h>
+
+#include <array>
+#include <chrono>
+#include <optional>
+
+namespace Lightly {
+
+    /// Measures the GPU time spent between begin() and end() with timestamp queries.
+    /// Results are collected a few frames later, so the pipeline is never stalled.
+    class GPUTimer {
+    public:
+        GPUTimer();
+        ~GPUTimer();
+
+        static bool supported();
+
+        void begin();
+        void end();
+
+        /// Returns the oldest measurement that has finished since the last call, if any
+        std::optional<std::chrono::nanoseconds> result();
+
+    private:
+        static constexpr int s_slotCount = 16;
+
+        std::array<GLuint, 2 * s_slotCount> m_queries {};
+        std::array<bool, s_slotCount> m_pending {};
+        int m_current = 0;
+        int m_oldest = 0;
+        bool m_running = false;
+        bool m_valid = false;
+    };
+
+} // namespace Lightly
@@ -0,0 +1,106 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "qualitygovernor.h"
+
+#include <algorithm>
+
+namespace Lightly {
+
+    // The share of the frame budget above which the quality is lowered
+    static constexpr double s_overloadShare = 0.35;
+    // The share of the frame budget the blur would take at the next higher quality, below which it's raised again.
+    // A step roughly halves the cost of the passes.
+    static constexpr double s_calmShare = 0.15;
+    // Frames to wait after a change before the average reflects the new quality, GPU timings arrive late
+    static constexpr int s_settleFrames = 15;
+    // Frames the load has to stay low before the quality is raised
+    static constexpr int s_calmFramesToRaise = 120;
+    // Weight of a new sample in the moving average
+    static constexpr double s_smoothing = 0.1;
+
+    void QualityGovernor::setEnabled(bool enabled)
+    {
+        m_enabled = enabled;
+        if (!enabled) {
+            setLevel(0);
+        }
+    }
+
+    bool QualityGovernor::isEnabled() const
+    {
+        return m_enabled;
+    }
+
+    void QualityGovernor::setMaximumLevel(int level)
+    {
+        m_maximumLevel = std::max(0, level);
+        if (m_level > m_maximumLevel) {
+            setLevel(m_maximumLevel);
+        }
+    }
+
+    void QualityGovernor::update(std::chrono::nanoseconds blurTime, std::chrono::nanoseconds frameBudget)
+    {
+        m_frameBudget = frameBudget;
+        m_averageTime += (blurTime.count() - m_averageTime) * s_smoothing;
+        if (!m_enabled || frameBudget.count() <= 0) {
+            return;
+        }
+
+        ++m_framesAtLevel;
+        if (m_framesAtLevel < s_settleFrames) {
+            return;
+        }
+
+        double const budget = frameBudget.count();
+        if (m_averageTime > budget * s_overloadShare && m_level < m_maximumLevel) {
+            setLevel(m_level + 1);
+            return;
+        }
+
+        if (m_level > 0 && m_averageTime * 2.0 < budget * s_calmShare) {
+            if (++m_calmFrames >= s_calmFramesToRaise) {
+                setLevel(m_level - 1);
+            }
+        } else {
+            m_calmFrames = 0;
+        }
+    }
+
+    void QualityGovernor::setLevel(int level)
+    {
+        if (level == m_level) {
+            return;
+        }
+
+        m_level = level;
+        m_framesAtLevel = 0;
+        m_calmFrames = 0;
+        ++m_levelChanges;
+    }
+
+    int QualityGovernor::level() const
+    {
+        return m_level;
+    }
+
+    std::chrono::nanoseconds QualityGovernor::averageTime() const
+    {
+        return std::chrono::nanoseconds(qint64(m_averageTime));
+    }
+
+    std::chrono::nanoseconds QualityGovernor::frameBudget() const
+    {
+        return m_frameBudget;
+    }
+
+    quint64 QualityGovernor::levelChanges() const
+    {
+        return m_levelChanges;
+    }
+
+} // namespace Lightly
@@ -0,0 +1,48 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QtGlobal>
+
+#include <chrono>
+
+namespace Lightly {
+
+    /// Lowers the blur quality step by step while the blur passes take too much of the frame budget,
+    /// and raises it again once the load has settled. The thresholds are apart and every change is
+    /// followed by a hold time, so the quality doesn't flip back and forth between frames.
+    class QualityGovernor {
+    public:
+        void setEnabled(bool enabled);
+        bool isEnabled() const;
+
+        /// The number of steps below full quality that are available
+        void setMaximumLevel(int level);
+
+        /// Called once per frame with the GPU time spent in the blur passes since the last call
+        void update(std::chrono::nanoseconds blurTime, std::chrono::nanoseconds frameBudget);
+
+        /// Steps below full quality, zero when the configured quality is used
+        int level() const;
+        std::chrono::nanoseconds averageTime() const;
+        std::chrono::nanoseconds frameBudget() const;
+        quint64 levelChanges() const;
+
+    private:
+        void setLevel(int level);
+
+        bool m_enabled = false;
+        int m_level = 0;
+        int m_maximumLevel = 0;
+        int m_framesAtLevel = 0;
+        int m_calmFrames = 0;
+        double m_averageTime = 0.0; // in nanoseconds
+        std::chrono::nanoseconds m_frameBudget {};
+        quint64 m_levelChanges = 0;
+    };
+
+} // namespace Lightly
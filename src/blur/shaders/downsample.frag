@@ -1,16 +1,23 @@
 uniform sampler2D texUnit;
 uniform float offset;
 uniform vec2 halfpixel;
+uniform vec4 textureBounds;
 
 varying vec2 uv;
 
+// The content may only fill a part of the texture, don't sample outside of it
+vec4 sampleTexture(vec2 coord)
+{
+    return texture2D(texUnit, clamp(coord, textureBounds.xy, textureBounds.zw));
+}
+
 void main(void)
 {
-    vec4 sum = texture2D(texUnit, uv) * 4.0;
-    sum += texture2D(texUnit, uv - halfpixel.xy * offset);
-    sum += texture2D(texUnit, uv + halfpixel.xy * offset);
-    sum += texture2D(texUnit, uv + vec2(halfpixel.x, -halfpixel.y) * offset);
-    sum += texture2D(texUnit, uv - vec2(halfpixel.x, -halfpixel.y) * offset);
+    vec4 sum = sampleTexture(uv) * 4.0;
+    sum += sampleTexture(uv - halfpixel.xy * offset);
+    sum += sampleTexture(uv + halfpixel.xy * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, -halfpixel.y) * offset);
+    sum += sampleTexture(uv - vec2(halfpixel.x, -halfpixel.y) * offset);
 
     gl_FragColor = sum / 8.0;
 }
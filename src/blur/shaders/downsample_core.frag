@@ -3,18 +3,25 @@
 uniform sampler2D texUnit;
 uniform float offset;
 uniform vec2 halfpixel;
+uniform vec4 textureBounds;
 
 in vec2 uv;
 
 out vec4 fragColor;
 
+// The content may only fill a part of the texture, don't sample outside of it
+vec4 sampleTexture(vec2 coord)
+{
+    return texture(texUnit, clamp(coord, textureBounds.xy, textureBounds.zw));
+}
+
 void main(void)
 {
-    vec4 sum = texture(texUnit, uv) * 4.0;
-    sum += texture(texUnit, uv - halfpixel.xy * offset);
-    sum += texture(texUnit, uv + halfpixel.xy * offset);
-    sum += texture(texUnit, uv + vec2(halfpixel.x, -halfpixel.y) * offset);
-    sum += texture(texUnit, uv - vec2(halfpixel.x, -halfpixel.y) * offset);
+    vec4 sum = sampleTexture(uv) * 4.0;
+    sum += sampleTexture(uv - halfpixel.xy * offset);
+    sum += sampleTexture(uv + halfpixel.xy * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, -halfpixel.y) * offset);
+    sum += sampleTexture(uv - vec2(halfpixel.x, -halfpixel.y) * offset);
 
     fragColor = sum / 8.0;
 }
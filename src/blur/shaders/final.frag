@@ -0,0 +1,77 @@
+uniform sampler2D texUnit;
+uniform float offset;
+uniform vec2 halfpixel;
+uniform vec4 textureBounds;
+uniform float noiseStrength;
+uniform float noiseScale;
+uniform float opacity;
+uniform vec4 cornerRect;
+uniform float cornerRadius;
+uniform float cornerExponent;
+uniform sampler2D maskUnit;
+uniform vec4 maskRect;
+uniform float maskEnabled;
+
+varying vec2 uv;
+
+// The content may only fill a part of the texture, don't sample outside of it
+vec4 sampleTexture(vec2 coord)
+{
+    return texture2D(texUnit, clamp(coord, textureBounds.xy, textureBounds.zw));
+}
+
+// A hash of the screen position, the noise masks banding of the smooth gradients in the blurred image
+float noise(vec2 position)
+{
+    vec3 p = fract(vec3(floor(position / noiseScale).xyx) * 0.1031);
+    p += dot(p, p.yzx + 33.33);
+    return fract((p.x + p.y) * p.z);
+}
+
+// Coverage of the rounded frame corners, the frame rect is given in gl_FragCoord coordinates.
+// A zero exponent means circular corners, otherwise the corners are superellipses with that exponent.
+float cornerCoverage(vec2 position)
+{
+    if (cornerRadius <= 0.0) {
+        return 1.0;
+    }
+
+    vec2 center = clamp(position, cornerRect.xy + cornerRadius, cornerRect.zw - cornerRadius);
+    vec2 delta = abs(position - center);
+    float dist;
+    if (cornerExponent > 0.0) {
+        dist = pow(pow(delta.x, cornerExponent) + pow(delta.y, cornerExponent), 1.0 / cornerExponent);
+    } else {
+        dist = length(delta);
+    }
+    return clamp(cornerRadius - dist + 0.5, 0.0, 1.0);
+}
+
+// Coverage of the blur shape if it's given as a mask, the mask rect is (x, y, 1 / width, 1 / height)
+// in gl_FragCoord coordinates
+float maskCoverage(vec2 position)
+{
+    if (maskEnabled <= 0.0) {
+        return 1.0;
+    }
+    return texture2D(maskUnit, (position - maskRect.xy) * maskRect.zw).r;
+}
+
+void main(void)
+{
+    vec4 sum = sampleTexture(uv + vec2(-halfpixel.x * 2.0, 0.0) * offset);
+    sum += sampleTexture(uv + vec2(-halfpixel.x, halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(0.0, halfpixel.y * 2.0) * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(halfpixel.x * 2.0, 0.0) * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, -halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(0.0, -halfpixel.y * 2.0) * offset);
+    sum += sampleTexture(uv + vec2(-halfpixel.x, -halfpixel.y) * offset) * 2.0;
+
+    sum /= 12.0;
+    sum.rgb += floor(noise(gl_FragCoord.xy) * noiseStrength) / 255.0;
+
+    // Premultiplied by the opacity and the coverage of the corners and the mask, blended with the source alpha
+    float alpha = opacity * cornerCoverage(gl_FragCoord.xy) * maskCoverage(gl_FragCoord.xy);
+    gl_FragColor = vec4(sum.rgb * alpha, alpha);
+}
@@ -1,19 +1,26 @@
 uniform sampler2D texUnit;
 uniform float offset;
 uniform vec2 halfpixel;
+uniform vec4 textureBounds;
 
 varying vec2 uv;
 
+// The content may only fill a part of the texture, don't sample outside of it
+vec4 sampleTexture(vec2 coord)
+{
+    return texture2D(texUnit, clamp(coord, textureBounds.xy, textureBounds.zw));
+}
+
 void main(void)
 {
-    vec4 sum = texture2D(texUnit, uv + vec2(-halfpixel.x * 2.0, 0.0) * offset);
-    sum += texture2D(texUnit, uv + vec2(-halfpixel.x, halfpixel.y) * offset) * 2.0;
-    sum += texture2D(texUnit, uv + vec2(0.0, halfpixel.y * 2.0) * offset);
-    sum += texture2D(texUnit, uv + vec2(halfpixel.x, halfpixel.y) * offset) * 2.0;
-    sum += texture2D(texUnit, uv + vec2(halfpixel.x * 2.0, 0.0) * offset);
-    sum += texture2D(texUnit, uv + vec2(halfpixel.x, -halfpixel.y) * offset) * 2.0;
-    sum += texture2D(texUnit, uv + vec2(0.0, -halfpixel.y * 2.0) * offset);
-    sum += texture2D(texUnit, uv + vec2(-halfpixel.x, -halfpixel.y) * offset) * 2.0;
+    vec4 sum = sampleTexture(uv + vec2(-halfpixel.x * 2.0, 0.0) * offset);
+    sum += sampleTexture(uv + vec2(-halfpixel.x, halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(0.0, halfpixel.y * 2.0) * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(halfpixel.x * 2.0, 0.0) * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, -halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(0.0, -halfpixel.y * 2.0) * offset);
+    sum += sampleTexture(uv + vec2(-halfpixel.x, -halfpixel.y) * offset) * 2.0;
 
     gl_FragColor = sum / 12.0;
 }
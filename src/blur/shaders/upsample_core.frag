@@ -3,21 +3,28 @@
 uniform sampler2D texUnit;
 uniform float offset;
 uniform vec2 halfpixel;
+uniform vec4 textureBounds;
 
 in vec2 uv;
 
 out vec4 fragColor;
 
+// The content may only fill a part of the texture, don't sample outside of it
+vec4 sampleTexture(vec2 coord)
+{
+    return texture(texUnit, clamp(coord, textureBounds.xy, textureBounds.zw));
+}
+
 void main(void)
 {
-    vec4 sum = texture(texUnit, uv + vec2(-halfpixel.x * 2.0, 0.0) * offset);
-    sum += texture(texUnit, uv + vec2(-halfpixel.x, halfpixel.y) * offset) * 2.0;
-    sum += texture(texUnit, uv + vec2(0.0, halfpixel.y * 2.0) * offset);
-    sum += texture(texUnit, uv + vec2(halfpixel.x, halfpixel.y) * offset) * 2.0;
-    sum += texture(texUnit, uv + vec2(halfpixel.x * 2.0, 0.0) * offset);
-    sum += texture(texUnit, uv + vec2(halfpixel.x, -halfpixel.y) * offset) * 2.0;
-    sum += texture(texUnit, uv + vec2(0.0, -halfpixel.y * 2.0) * offset);
-    sum += texture(texUnit, uv + vec2(-halfpixel.x, -halfpixel.y) * offset) * 2.0;
+    vec4 sum = sampleTexture(uv + vec2(-halfpixel.x * 2.0, 0.0) * offset);
+    sum += sampleTexture(uv + vec2(-halfpixel.x, halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(0.0, halfpixel.y * 2.0) * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(halfpixel.x * 2.0, 0.0) * offset);
+    sum += sampleTexture(uv + vec2(halfpixel.x, -halfpixel.y) * offset) * 2.0;
+    sum += sampleTexture(uv + vec2(0.0, -halfpixel.y * 2.0) * offset);
+    sum += sampleTexture(uv + vec2(-halfpixel.x, -halfpixel.y) * offset) * 2.0;
 
     fragColor = sum / 12.0;
 }
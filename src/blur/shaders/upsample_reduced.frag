@@ -0,0 +1,27 @@
+uniform sampler2D texUnit;
+uniform float offset;
+uniform vec2 halfpixel;
+uniform vec4 textureBounds;
+uniform float tapSpread;
+
+varying vec2 uv;
+
+// The content may only fill a part of the texture, don't sample outside of it
+vec4 sampleTexture(vec2 coord)
+{
+    return texture2D(texUnit, clamp(coord, textureBounds.xy, textureBounds.zw));
+}
+
+// Four equal diagonal taps in place of the eight of the regular kernel. They are placed at
+// tapSpread, see reducedTapSpread(), which keeps the variance of the kernel.
+void main(void)
+{
+    vec2 spread = halfpixel * offset * tapSpread;
+
+    vec4 sum = sampleTexture(uv - spread);
+    sum += sampleTexture(uv + spread);
+    sum += sampleTexture(uv + vec2(spread.x, -spread.y));
+    sum += sampleTexture(uv - vec2(spread.x, -spread.y));
+
+    gl_FragColor = sum / 4.0;
+}
@@ -1,4 +1,6 @@
 uniform mat4 modelViewProjectionMatrix;
+uniform vec2 textureScale;
+uniform vec2 textureOffset;
 
 attribute vec2 position;
 attribute vec2 texcoord;
@@ -8,5 +10,5 @@ varying vec2 uv;
 void main(void)
 {
     gl_Position = modelViewProjectionMatrix * vec4(position, 0.0, 1.0);
-    uv = texcoord;
+    uv = texcoord * textureScale + textureOffset;
 }
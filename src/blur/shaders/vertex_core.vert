@@ -1,6 +1,8 @@
 #version 140
 
 uniform mat4 modelViewProjectionMatrix;
+uniform vec2 textureScale;
+uniform vec2 textureOffset;
 
 in vec2 position;
 in vec2 texcoord;
@@ -10,5 +12,5 @@ out vec2 uv;
 void main(void)
 {
     gl_Position = modelViewProjectionMatrix * vec4(position, 0.0, 1.0);
-    uv = texcoord;
+    uv = texcoord * textureScale + textureOffset;
 }
@@ -0,0 +1,192 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "texturepool.h"
+
+#include <QLoggingCategory>
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+Q_DECLARE_LOGGING_CATEGORY(KWIN_BLUR)
+
+namespace Lightly {
+
+    TextureLease::TextureLease(TextureLease&& other) noexcept
+        : m_pool(std::exchange(other.m_pool, nullptr))
+        , m_entry(std::exchange(other.m_entry, nullptr))
+        , m_size(other.m_size)
+    {
+    }
+
+    TextureLease& TextureLease::operator=(TextureLease&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            m_pool = std::exchange(other.m_pool, nullptr);
+            m_entry = std::exchange(other.m_entry, nullptr);
+            m_size = other.m_size;
+        }
+        return *this;
+    }
+
+    TextureLease::~TextureLease()
+    {
+        release();
+    }
+
+    void TextureLease::release()
+    {
+        if (m_entry) {
+            m_pool->release(m_entry);
+            m_entry = nullptr;
+            m_pool = nullptr;
+        }
+    }
+
+    QVector2D TextureLease::textureScale() const
+    {
+        KWin::GLTexture const* t = texture();
+        return QVector2D(float(m_size.width()) / t->width(), float(m_size.height()) / t->height());
+    }
+
+    QVector4D TextureLease::textureBounds() const
+    {
+        KWin::GLTexture const* t = texture();
+        return QVector4D(0.5f / t->width(), 0.5f / t->height(), (m_size.width() - 0.5f) / t->width(), (m_size.height() - 0.5f) / t->height());
+    }
+
+    TexturePool::TexturePool()
+    {
+        m_rateTimer.start();
+    }
+
+    TexturePool::~TexturePool()
+    {
+        // Leases that outlive the pool must not give their textures back
+        for (auto const& entry : m_entries) {
+            Q_ASSERT(!entry->leased);
+        }
+    }
+
+    void TexturePool::setBudget(qint64 bytes)
+    {
+        m_budget = bytes;
+        trim();
+    }
+
+    QSize TexturePool::bucketSize(QSize const& size)
+    {
+        // Steps of an eighth of the power of two below, at most 12.5% of waste per dimension
+        auto roundUp = [](int value) {
+            int const step = std::max(32, int(std::bit_floor(unsigned(std::max(value, 1)))) / 8);
+            return (value + step - 1) / step * step;
+        };
+        return QSize(roundUp(size.width()), roundUp(size.height()));
+    }
+
+    qint64 TexturePool::bytesPerPixel(GLenum format)
+    {
+        // The final level keeps the format of the output, which may be any of these
+        switch (format) {
+        case GL_RGBA16F:
+        case GL_RGB16F:
+        case GL_RGBA16:
+        case GL_RGB16:
+            return 8;
+        case GL_RGB32F:
+            return 12;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    TextureLease TexturePool::acquire(GLenum format, QSize const& size)
+    {
+        TextureLease lease;
+        QSize const bucket = bucketSize(size);
+
+        PooledTexture* entry = nullptr;
+        for (auto const& candidate : m_entries) {
+            if (!candidate->leased && candidate->format == format && candidate->texture->size() == bucket) {
+                entry = candidate.get();
+                break;
+            }
+        }
+
+        if (!entry) {
+            auto texture = KWin::GLTexture::allocate(format, bucket);
+            if (!texture) {
+                qCWarning(KWIN_BLUR) << "Failed to allocate an offscreen texture";
+                return lease;
+            }
+            texture->setFilter(GL_LINEAR);
+            texture->setWrapMode(GL_CLAMP_TO_EDGE);
+
+            auto framebuffer = std::make_unique<KWin::GLFramebuffer>(texture.get());
+            if (!framebuffer->valid()) {
+                qCWarning(KWIN_BLUR) << "Failed to create an offscreen framebuffer";
+                return lease;
+            }
+
+            auto pooled = std::make_unique<PooledTexture>();
+            pooled->texture = std::move(texture);
+            pooled->framebuffer = std::move(framebuffer);
+            pooled->format = format;
+            pooled->bytes = qint64(bucket.width()) * bucket.height() * bytesPerPixel(format);
+
+            m_bytes += pooled->bytes;
+            ++m_allocations;
+            ++m_rateAllocations;
+
+            entry = pooled.get();
+            m_entries.push_back(std::move(pooled));
+        }
+
+        entry->leased = true;
+        entry->lastUsed = ++m_clock;
+
+        lease.m_pool = this;
+        lease.m_entry = entry;
+        lease.m_size = size;
+        return lease;
+    }
+
+    void TexturePool::release(PooledTexture* entry)
+    {
+        entry->leased = false;
+        entry->lastUsed = ++m_clock;
+    }
+
+    void TexturePool::trim()
+    {
+        if (qint64 const elapsed = m_rateTimer.elapsed(); elapsed >= 1000) {
+            m_allocationRate = m_rateAllocations * 1000.0 / elapsed;
+            m_rateAllocations = 0;
+            m_rateTimer.restart();
+        }
+
+        while (m_bytes > m_budget) {
+            auto oldest = m_entries.end();
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+                if (!(*it)->leased && (oldest == m_entries.end() || (*it)->lastUsed < (*oldest)->lastUsed)) {
+                    oldest = it;
+                }
+            }
+            if (oldest == m_entries.end()) {
+                // Everything left is in use
+                break;
+            }
+
+            m_bytes -= (*oldest)->bytes;
+            m_entries.erase(oldest);
+        }
+    }
+
+} // namespace Lightly
@@ -0,0 +1,135 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "opengl/glutils.h"
+
+#include <QElapsedTimer>
+#include <QSize>
+#include <QVector2D>
+#include <QVector4D>
+
+#include <memory>
+#include <vector>
+
+namespace Lightly {
+
+    class TexturePool;
+
+    struct PooledTexture {
+        std::unique_ptr<KWin::GLTexture> texture;
+        std::unique_ptr<KWin::GLFramebuffer> framebuffer;
+        GLenum format = GL_RGBA8;
+        qint64 bytes = 0;
+        quint64 lastUsed = 0;
+        bool leased = false;
+    };
+
+    /// A render target borrowed from the texture pool, it's given back when the lease is destroyed.
+    /// The texture can be larger than requested, the content lives in its bottom left corner.
+    class TextureLease {
+    public:
+        TextureLease() = default;
+        TextureLease(TextureLease&& other) noexcept;
+        TextureLease& operator=(TextureLease&& other) noexcept;
+        ~TextureLease();
+
+        bool isValid() const
+        {
+            return m_entry != nullptr;
+        }
+
+        KWin::GLTexture* texture() const
+        {
+            return m_entry->texture.get();
+        }
+
+        KWin::GLFramebuffer* framebuffer() const
+        {
+            return m_entry->framebuffer.get();
+        }
+
+        /// The size of the content, in texels
+        QSize size() const
+        {
+            return m_size;
+        }
+
+        void setSize(QSize const& size)
+        {
+            m_size = size;
+        }
+
+        /// Maps texture coordinates of the content to texture coordinates of the whole texture
+        QVector2D textureScale() const;
+
+        /// Texture coordinates of the outermost content texel centers, (min x, min y, max x, max y)
+        QVector4D textureBounds() const;
+
+        void release();
+
+    private:
+        friend class TexturePool;
+
+        TexturePool* m_pool = nullptr;
+        PooledTexture* m_entry = nullptr;
+        QSize m_size;
+    };
+
+    /// Keeps the offscreen render targets of the blur effect. Sizes are rounded up to buckets so that
+    /// resized windows can keep or swap their textures, unused ones are evicted least recently used first
+    /// once the pool grows over its memory budget.
+    class TexturePool {
+    public:
+        TexturePool();
+        ~TexturePool();
+
+        void setBudget(qint64 bytes);
+
+        /// The size of the texture that will back content of the given size
+        static QSize bucketSize(QSize const& size);
+
+        /// An estimate of the memory a texel of the format takes
+        static qint64 bytesPerPixel(GLenum format);
+
+        TextureLease acquire(GLenum format, QSize const& size);
+
+        /// Evicts unused textures over the budget, called once per frame
+        void trim();
+
+        quint64 allocations() const
+        {
+            return m_allocations;
+        }
+
+        qreal allocationsPerSecond() const
+        {
+            return m_allocationRate;
+        }
+
+        qint64 bytes() const
+        {
+            return m_bytes;
+        }
+
+    private:
+        friend class TextureLease;
+
+        void release(PooledTexture* entry);
+
+        std::vector<std::unique_ptr<PooledTexture>> m_entries;
+        qint64 m_budget = 0;
+        qint64 m_bytes = 0;
+        quint64 m_clock = 0;
+
+        quint64 m_allocations = 0;
+        quint64 m_rateAllocations = 0;
+        qreal m_allocationRate = 0;
+        QElapsedTimer m_rateTimer;
+    };
+
+} // namespace Lightly
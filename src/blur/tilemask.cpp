@@ -0,0 +1,197 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "tilemask.h"
+
+#include <algorithm>
+
+namespace Lightly {
+
+    static int floorDiv(int value, int divisor)
+    {
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+
+    static int ceilDiv(int value, int divisor)
+    {
+        return -floorDiv(-value, divisor);
+    }
+
+    void TileMask::reset(QRect const& area)
+    {
+        m_area = area;
+        m_columns = std::max(0, ceilDiv(area.width(), s_tileSize));
+        m_rows = std::max(0, ceilDiv(area.height(), s_tileSize));
+        m_wordsPerRow = (m_columns + 63) / 64;
+        m_words.assign(size_t(m_wordsPerRow) * m_rows, 0);
+    }
+
+    void TileMask::clear()
+    {
+        std::fill(m_words.begin(), m_words.end(), 0);
+    }
+
+    TileMask::TileRange TileMask::touchedTiles(QRect const& rect) const
+    {
+        if (rect.isEmpty()) {
+            return {0, 0, -1, -1};
+        }
+
+        int const x = rect.x() - m_area.x();
+        int const y = rect.y() - m_area.y();
+        return {
+            std::max(0, floorDiv(x, s_tileSize)),
+            std::max(0, floorDiv(y, s_tileSize)),
+            std::min(m_columns - 1, floorDiv(x + rect.width() - 1, s_tileSize)),
+            std::min(m_rows - 1, floorDiv(y + rect.height() - 1, s_tileSize)),
+        };
+    }
+
+    TileMask::TileRange TileMask::coveredTiles(QRect const& rect) const
+    {
+        if (rect.isEmpty()) {
+            return {0, 0, -1, -1};
+        }
+
+        // the last column and row can be cut by the edge of the area, they count as covered
+        // if the rect reaches past that edge
+        int const x = rect.x() - m_area.x();
+        int const y = rect.y() - m_area.y();
+        int const right = x + rect.width();
+        int const bottom = y + rect.height();
+        return {
+            std::max(0, ceilDiv(x, s_tileSize)),
+            std::max(0, ceilDiv(y, s_tileSize)),
+            right >= m_area.width() ? m_columns - 1 : floorDiv(right, s_tileSize) - 1,
+            bottom >= m_area.height() ? m_rows - 1 : floorDiv(bottom, s_tileSize) - 1,
+        };
+    }
+
+    void TileMask::setRange(TileRange const& range, bool value)
+    {
+        if (range.isEmpty()) {
+            return;
+        }
+
+        int const firstWord = range.left / 64;
+        int const lastWord = range.right / 64;
+        for (int row = range.top; row <= range.bottom; ++row) {
+            std::uint64_t* words = m_words.data() + size_t(row) * m_wordsPerRow;
+            for (int word = firstWord; word <= lastWord; ++word) {
+                int const low = word == firstWord ? range.left % 64 : 0;
+                int const high = word == lastWord ? range.right % 64 : 63;
+                std::uint64_t const mask = (~std::uint64_t(0) << low) & (~std::uint64_t(0) >> (63 - high));
+                words[word] = value ? words[word] | mask : words[word] & ~mask;
+            }
+        }
+    }
+
+    bool TileMask::testRange(TileRange const& range) const
+    {
+        if (range.isEmpty()) {
+            return false;
+        }
+
+        int const firstWord = range.left / 64;
+        int const lastWord = range.right / 64;
+        for (int row = range.top; row <= range.bottom; ++row) {
+            std::uint64_t const* words = m_words.data() + size_t(row) * m_wordsPerRow;
+            for (int word = firstWord; word <= lastWord; ++word) {
+                int const low = word == firstWord ? range.left % 64 : 0;
+                int const high = word == lastWord ? range.right % 64 : 63;
+                std::uint64_t const mask = (~std::uint64_t(0) << low) & (~std::uint64_t(0) >> (63 - high));
+                if (words[word] & mask) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void TileMask::add(QRect const& rect)
+    {
+        setRange(touchedTiles(rect), true);
+    }
+
+    void TileMask::add(QRegion const& region)
+    {
+        for (QRect const& rect : region) {
+            setRange(touchedTiles(rect), true);
+        }
+    }
+
+    void TileMask::subtractCovered(QRect const& rect)
+    {
+        setRange(coveredTiles(rect), false);
+    }
+
+    void TileMask::subtractCovered(QRegion const& region)
+    {
+        for (QRect const& rect : region) {
+            setRange(coveredTiles(rect), false);
+        }
+    }
+
+    bool TileMask::intersects(QRect const& rect) const
+    {
+        return testRange(touchedTiles(rect));
+    }
+
+    bool TileMask::intersects(QRegion const& region) const
+    {
+        for (QRect const& rect : region) {
+            if (testRange(touchedTiles(rect))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    QRegion TileMask::toRegion() const
+    {
+        return toRegion(m_area);
+    }
+
+    QRegion TileMask::toRegion(QRect const& clip) const
+    {
+        QRect const bounds = clip & m_area;
+        TileRange const range = touchedTiles(bounds);
+        if (range.isEmpty()) {
+            return QRegion();
+        }
+
+        // every row of tiles is a band and runs of set tiles are separated by at least one clear
+        // tile, so the rects are already in the order QRegion keeps them
+        m_rects.clear();
+        for (int row = range.top; row <= range.bottom; ++row) {
+            std::uint64_t const* words = m_words.data() + size_t(row) * m_wordsPerRow;
+            int column = range.left;
+            while (column <= range.right) {
+                if (!words[column / 64]) {
+                    column = (column / 64 + 1) * 64;
+                    continue;
+                }
+                if (!(words[column / 64] & (std::uint64_t(1) << (column % 64)))) {
+                    ++column;
+                    continue;
+                }
+
+                int const first = column;
+                while (column <= range.right && (words[column / 64] & (std::uint64_t(1) << (column % 64)))) {
+                    ++column;
+                }
+                QRect const tiles(m_area.x() + first * s_tileSize, m_area.y() + row * s_tileSize,
+                                  (column - first) * s_tileSize, s_tileSize);
+                m_rects.push_back(tiles & bounds);
+            }
+        }
+
+        QRegion region;
+        region.setRects(m_rects.data(), int(m_rects.size()));
+        return region;
+    }
+
+} // namespace Lightly
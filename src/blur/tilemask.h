@@ -0,0 +1,70 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include <QRect>
+#include <QRegion>
+
+#include <cstdint>
+#include <vector>
+
+namespace Lightly {
+
+    /// A coarse mask of an output made of square tiles, one bit per tile. It replaces exact regions
+    /// where only a conservative answer is needed: tiles are set when a rect touches them and cleared
+    /// only when a rect covers them completely, so the mask never ends up smaller than the exact region.
+    /// The operations work on whole 64-bit words per row, loops the compiler can vectorize.
+    class TileMask {
+    public:
+        static constexpr int s_tileSize = 32;
+
+        /// Clears the mask and sizes it to cover the given area, the storage is kept between frames
+        void reset(QRect const& area);
+        void clear();
+
+        /// Sets every tile the rect or region touches
+        void add(QRect const& rect);
+        void add(QRegion const& region);
+
+        /// Clears the tiles the rect or region covers completely
+        void subtractCovered(QRect const& rect);
+        void subtractCovered(QRegion const& region);
+
+        bool intersects(QRect const& rect) const;
+        bool intersects(QRegion const& region) const;
+
+        /// The set tiles as a region, clipped to the mask area and to the given rect
+        QRegion toRegion() const;
+        QRegion toRegion(QRect const& clip) const;
+
+    private:
+        struct TileRange {
+            int left;
+            int top;
+            int right;
+            int bottom;
+
+            bool isEmpty() const
+            {
+                return left > right || top > bottom;
+            }
+        };
+
+        TileRange touchedTiles(QRect const& rect) const;
+        TileRange coveredTiles(QRect const& rect) const;
+        void setRange(TileRange const& range, bool value);
+        bool testRange(TileRange const& range) const;
+
+        QRect m_area;
+        int m_columns = 0;
+        int m_rows = 0;
+        int m_wordsPerRow = 0;
+        std::vector<std::uint64_t> m_words;
+        mutable std::vector<QRect> m_rects; // scratch space for toRegion()
+    };
+
+} // namespace Lightly
@@ -0,0 +1,242 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "bandregion.h"
+
+#include <cmath>
+
+namespace Lightly {
+    // QRect has inclusive right and bottom edges, the sweep works with exclusive ones
+    static int rightEdge(QRect const& rect)
+    {
+        return rect.x() + rect.width();
+    }
+
+    static int bottomEdge(QRect const& rect)
+    {
+        return rect.y() + rect.height();
+    }
+
+    BandRegion::BandRegion(QRegion const& region)
+    {
+        assign(region);
+    }
+
+    void BandRegion::assign(QRegion const& region)
+    {
+        // QRegion keeps its rects banded already
+        m_rects.assign(region.begin(), region.end());
+    }
+
+    void BandRegion::assign(QRect const& rect)
+    {
+        m_rects.clear();
+        if (rect.width() > 0 && rect.height() > 0) {
+            m_rects.push_back(rect);
+        }
+    }
+
+    void BandRegion::assign(BandRegion const& other)
+    {
+        m_rects.assign(other.m_rects.begin(), other.m_rects.end());
+    }
+
+    void BandRegion::clear()
+    {
+        m_rects.clear();
+    }
+
+    QRegion BandRegion::toRegion() const
+    {
+        QRegion region;
+        region.setRects(m_rects.data(), int(m_rects.size()));
+        return region;
+    }
+
+    QRect BandRegion::boundingRect() const
+    {
+        if (m_rects.empty()) {
+            return QRect();
+        }
+
+        int left = m_rects.front().x();
+        int right = rightEdge(m_rects.front());
+        for (QRect const& rect : m_rects) {
+            left = std::min(left, rect.x());
+            right = std::max(right, rightEdge(rect));
+        }
+        return QRect(left, m_rects.front().y(), right - left, bottomEdge(m_rects.back()) - m_rects.front().y());
+    }
+
+    void BandRegion::translate(QPoint const& offset)
+    {
+        for (QRect& rect : m_rects) {
+            rect.translate(offset);
+        }
+    }
+
+    void BandRegion::transform(QPointF const& origin, qreal xScale, qreal yScale, QPointF const& translation)
+    {
+        auto mapX = [&](int x) {
+            return int(std::floor(origin.x() + (x - origin.x()) * xScale + translation.x()));
+        };
+        auto mapY = [&](int y) {
+            return int(std::floor(origin.y() + (y - origin.y()) * yScale + translation.y()));
+        };
+
+        // The mapping is monotonic, so the bands stay sorted. Collapsed rects are dropped and spans that
+        // touch after rounding are merged, all in place.
+        m_scratch.swap(m_rects);
+        std::vector<QRect> const& rects = m_scratch;
+        m_rects.clear();
+        m_bandStart = 0;
+        m_previousBandStart = 0;
+
+        for (size_t start = 0; start < rects.size();) {
+            size_t const end = bandEnd(rects, start);
+            int const top = mapY(rects[start].y());
+            int const bottom = mapY(bottomEdge(rects[start]));
+            if (top < bottom) {
+                for (size_t i = start; i < end; ++i) {
+                    appendSpan(mapX(rects[i].x()), mapX(rightEdge(rects[i])), top, bottom);
+                }
+                finishBand();
+            }
+            start = end;
+        }
+    }
+
+    void BandRegion::intersected(BandRegion const& a, BandRegion const& b, BandRegion& result)
+    {
+        combine(a, b, result, Operation::Intersect);
+    }
+
+    void BandRegion::subtracted(BandRegion const& a, BandRegion const& b, BandRegion& result)
+    {
+        combine(a, b, result, Operation::Subtract);
+    }
+
+    size_t BandRegion::bandEnd(std::vector<QRect> const& rects, size_t start)
+    {
+        size_t end = start + 1;
+        while (end < rects.size() && rects[end].y() == rects[start].y()) {
+            ++end;
+        }
+        return end;
+    }
+
+    void BandRegion::appendSpan(int left, int right, int top, int bottom)
+    {
+        if (left >= right) {
+            return;
+        }
+        if (m_rects.size() > m_bandStart && rightEdge(m_rects.back()) >= left) {
+            QRect& last = m_rects.back();
+            last.setRight(std::max(right, rightEdge(last)) - 1);
+            return;
+        }
+        m_rects.emplace_back(left, top, right - left, bottom - top);
+    }
+
+    void BandRegion::finishBand()
+    {
+        size_t const bandSize = m_rects.size() - m_bandStart;
+        size_t const previousSize = m_bandStart - m_previousBandStart;
+
+        // Coalesce with the band above if it ends where this one starts and has the same spans
+        bool coalesce = bandSize > 0 && bandSize == previousSize
+            && bottomEdge(m_rects[m_previousBandStart]) == m_rects[m_bandStart].y();
+        for (size_t i = 0; coalesce && i < bandSize; ++i) {
+            QRect const& above = m_rects[m_previousBandStart + i];
+            QRect const& current = m_rects[m_bandStart + i];
+            coalesce = above.x() == current.x() && above.width() == current.width();
+        }
+
+        if (coalesce) {
+            int const bottom = bottomEdge(m_rects[m_bandStart]);
+            for (size_t i = m_previousBandStart; i < m_bandStart; ++i) {
+                m_rects[i].setBottom(bottom - 1);
+            }
+            m_rects.resize(m_bandStart);
+        } else if (bandSize > 0) {
+            m_previousBandStart = m_bandStart;
+        }
+        m_bandStart = m_rects.size();
+    }
+
+    void BandRegion::combine(BandRegion const& a, BandRegion const& b, BandRegion& result, Operation operation)
+    {
+        Q_ASSERT(&result != &a && &result != &b);
+
+        result.m_rects.clear();
+        result.m_bandStart = 0;
+        result.m_previousBandStart = 0;
+
+        std::vector<QRect> const& aRects = a.m_rects;
+        std::vector<QRect> const& bRects = b.m_rects;
+
+        // Emits the spans of the a band between top and bottom, combined with the spans of the b band
+        auto emitBand = [&](size_t aStart, size_t aEnd, size_t bStart, size_t bEnd, int top, int bottom) {
+            size_t j = bStart;
+            for (size_t i = aStart; i < aEnd; ++i) {
+                int left = aRects[i].x();
+                int const right = rightEdge(aRects[i]);
+
+                while (j < bEnd && rightEdge(bRects[j]) <= left) {
+                    ++j;
+                }
+
+                if (operation == Operation::Intersect) {
+                    for (size_t k = j; k < bEnd && bRects[k].x() < right; ++k) {
+                        result.appendSpan(std::max(left, bRects[k].x()), std::min(right, rightEdge(bRects[k])), top, bottom);
+                    }
+                } else {
+                    for (size_t k = j; k < bEnd && bRects[k].x() < right; ++k) {
+                        result.appendSpan(left, std::min(right, bRects[k].x()), top, bottom);
+                        left = std::max(left, rightEdge(bRects[k]));
+                    }
+                    result.appendSpan(left, right, top, bottom);
+                }
+            }
+            result.finishBand();
+        };
+
+        size_t ib = 0;
+        for (size_t ia = 0; ia < aRects.size();) {
+            size_t const aEnd = bandEnd(aRects, ia);
+            int top = aRects[ia].y();
+            int const aBottom = bottomEdge(aRects[ia]);
+
+            while (top < aBottom) {
+                // Skip the b bands above what's left of the a band
+                while (ib < bRects.size() && bottomEdge(bRects[ib]) <= top) {
+                    ib = bandEnd(bRects, ib);
+                }
+
+                if (ib == bRects.size() || bRects[ib].y() >= aBottom) {
+                    // Nothing of b overlaps the rest of the a band
+                    if (operation == Operation::Subtract) {
+                        emitBand(ia, aEnd, 0, 0, top, aBottom);
+                    }
+                    break;
+                }
+
+                if (bRects[ib].y() > top) {
+                    if (operation == Operation::Subtract) {
+                        emitBand(ia, aEnd, 0, 0, top, bRects[ib].y());
+                    }
+                    top = bRects[ib].y();
+                }
+
+                int const bottom = std::min(aBottom, bottomEdge(bRects[ib]));
+                emitBand(ia, aEnd, ib, bandEnd(bRects, ib), top, bottom);
+                top = bottom;
+            }
+
+            ia = aEnd;
+        }
+    }
+} // namespace
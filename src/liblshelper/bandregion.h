@@ -0,0 +1,72 @@
+/*
+    SPDX-FileCopyrightText: 2026 LightlyShaders contributors
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#pragma once
+
+#include "liblshelper_export.h"
+
+#include <QPointF>
+#include <QRect>
+#include <QRegion>
+
+#include <span>
+#include <vector>
+
+namespace Lightly {
+    /// A region stored as a flat array of y-x banded rects, the same layout QRegion uses: rects are sorted
+    /// by y, rects in a band share top and bottom and are sorted by x without overlapping.
+    /// Operations sweep both regions band by band and write into an existing region, which keeps its
+    /// capacity, so they don't allocate once the buffers have grown.
+    class LIBLSHELPER_EXPORT BandRegion {
+    public:
+        BandRegion() = default;
+        explicit BandRegion(QRegion const& region);
+
+        void assign(QRegion const& region);
+        void assign(QRect const& rect);
+        void assign(BandRegion const& other);
+        void clear();
+        QRegion toRegion() const;
+
+        bool isEmpty() const
+        {
+            return m_rects.empty();
+        }
+
+        std::span<QRect const> rects() const
+        {
+            return m_rects;
+        }
+
+        QRect boundingRect() const;
+
+        void translate(QPoint const& offset);
+
+        /// Maps every edge e to floor(origin + (e - origin) * scale + translation), the way a scaled window
+        /// is mapped. Scales must be positive.
+        void transform(QPointF const& origin, qreal xScale, qreal yScale, QPointF const& translation);
+
+        static void intersected(BandRegion const& a, BandRegion const& b, BandRegion& result);
+        static void subtracted(BandRegion const& a, BandRegion const& b, BandRegion& result);
+
+    private:
+        enum class Operation {
+            Intersect,
+            Subtract,
+        };
+
+        static void combine(BandRegion const& a, BandRegion const& b, BandRegion& result, Operation operation);
+        static size_t bandEnd(std::vector<QRect> const& rects, size_t start);
+
+        void appendSpan(int left, int right, int top, int bottom);
+        void finishBand();
+
+        std::vector<QRect> m_rects;
+        std::vector<QRect> m_scratch; // the previous rects while transforming in place
+        size_t m_bandStart = 0; // first rect of the band being built
+        size_t m_previousBandStart = 0;
+    };
+} // namespace
@@ -1,29 +1,17 @@
 #include "lshelper.h"
 #include "lightlyshaders_config.h"
 
-#include <QBitmap>
-#include <QPainter>
-#include <QPainterPath>
-#include <QtMath>
+#include <QRegularExpression>
 
 Q_LOGGING_CATEGORY(LSHELPER, "liblshelper", QtWarningMsg)
 
 namespace Lightly {
     LSHelper::LSHelper()
     {
-        for (int i = 0; i < NTex; ++i) {
-            maskedRegions[i] = 0;
-        }
     }
 
     LSHelper::~LSHelper()
     {
-        // delete mask regions
-        for (int i = 0; i < NTex; ++i) {
-            if (maskedRegions[i])
-                delete maskedRegions[i];
-        }
-
         m_managed.clear();
     }
 
@@ -33,15 +21,12 @@ namespace Lightly {
 
         m_cornersType = LightlyShadersConfig::cornersType();
         m_squircleRatio = LightlyShadersConfig::squircleRatio();
-        m_shadowOffset = LightlyShadersConfig::shadowOffset();
         m_size = LightlyShadersConfig::roundness();
         m_disabledForMaximized = LightlyShadersConfig::disabledForMaximized();
 
         if (m_cornersType == SquircledCorners) {
             m_size = m_size * 0.5 * m_squircleRatio;
         }
-
-        setMaskRegions();
     }
 
     int LSHelper::roundness() const
@@ -49,160 +34,28 @@ namespace Lightly {
         return m_size;
     }
 
-    void LSHelper::setMaskRegions()
+    int LSHelper::cornerExponent() const
     {
-        int size = m_size + m_shadowOffset;
-        QImage img = genMaskImg(size, true, false);
-
-        maskedRegions[TopLeft] = createMaskRegion(img, size, TopLeft);
-        maskedRegions[TopRight] = createMaskRegion(img, size, TopRight);
-        maskedRegions[BottomRight] = createMaskRegion(img, size, BottomRight);
-        maskedRegions[BottomLeft] = createMaskRegion(img, size, BottomLeft);
+        return m_cornersType == SquircledCorners ? m_squircleRatio : 0;
     }
 
-    QRegion* LSHelper::createMaskRegion(QImage img, int size, int corner)
+    bool LSHelper::cornerShape(KWin::EffectWindow* w, CornerShape* shape)
     {
-        QImage img_copy;
-
-        switch (corner) {
-        case TopLeft:
-            img_copy = img.copy(0, 0, size, size);
-            break;
-        case TopRight:
-            img_copy = img.copy(size, 0, size, size);
-            break;
-        case BottomRight:
-            img_copy = img.copy(size, size, size, size);
-            break;
-        case BottomLeft:
-            img_copy = img.copy(0, size, size, size);
-            break;
-        }
-
-        img_copy = img_copy.createMaskFromColor(QColor(Qt::black).rgb(), Qt::MaskOutColor);
-        QBitmap bitmap = QBitmap::fromImage(img_copy, Qt::DiffuseAlphaDither);
-
-        return new QRegion(bitmap);
-    }
-
-    void LSHelper::roundBlurRegion(KWin::EffectWindow* w, QRegion* blur_region)
-    {
-        if (blur_region->isEmpty()) {
-            return;
-        }
-
-        if (!m_managed.contains(w)) {
-            return;
+        if (m_size <= 0 || !m_managed.contains(w)) {
+            return false;
         }
 
         QRectF const geo(w->frameGeometry());
 
         QRectF maximized_area = KWin::effects->clientArea(KWin::MaximizeArea, w);
         if (maximized_area == geo && m_disabledForMaximized) {
-            return;
-        }
-
-        QRegion top_left = *maskedRegions[TopLeft];
-        top_left.translate(0 - m_shadowOffset + 1, 0 - m_shadowOffset + 1);
-        *blur_region = blur_region->subtracted(top_left);
-
-        QRegion top_right = *maskedRegions[TopRight];
-        top_right.translate(geo.width() - m_size - 1, 0 - m_shadowOffset + 1);
-        *blur_region = blur_region->subtracted(top_right);
-
-        QRegion bottom_right = *maskedRegions[BottomRight];
-        bottom_right.translate(geo.width() - m_size - 1, geo.height() - m_size - 1);
-        *blur_region = blur_region->subtracted(bottom_right);
-
-        QRegion bottom_left = *maskedRegions[BottomLeft];
-        bottom_left.translate(0 - m_shadowOffset + 1, geo.height() - m_size - 1);
-        *blur_region = blur_region->subtracted(bottom_left);
-    }
-
-    QPainterPath LSHelper::superellipse(float size, int n, int translate)
-    {
-        float n2 = 2.0 / n;
-
-        int steps = 360;
-
-        float step = (2 * M_PI) / steps;
-
-        QPainterPath path;
-        path.moveTo(2 * size, size);
-
-        for (int i = 1; i < steps; ++i) {
-            float t = i * step;
-
-            float cosT = qCos(t);
-            float sinT = qSin(t);
-
-            float x = size + (qPow(qAbs(cosT), n2) * size * signum(cosT));
-            float y = size - (qPow(qAbs(sinT), n2) * size * signum(sinT));
-
-            path.lineTo(x, y);
-
-            // qCWarning(LSHELPER) << "x: " << x << ", y: " << y << ", t: " << t << ", size: " << size << ", sinT: " << sinT << ", cosT: " << cosT << ", n2: " << n2;
-        }
-        path.lineTo(2 * size, size);
-
-        path.translate(translate, translate);
-
-        return path;
-    }
-
-    QImage LSHelper::genMaskImg(int size, bool mask, bool outer_rect)
-    {
-        QImage img(size * 2, size * 2, QImage::Format_ARGB32_Premultiplied);
-        img.fill(Qt::transparent);
-        QPainter p(&img);
-        QRect r(img.rect());
-        int offset_decremented;
-        if (outer_rect) {
-            offset_decremented = m_shadowOffset - 1;
-        } else {
-            offset_decremented = m_shadowOffset;
-        }
-
-        if (mask) {
-            p.fillRect(img.rect(), Qt::black);
-            p.setCompositionMode(QPainter::CompositionMode_DestinationOut);
-            p.setPen(Qt::NoPen);
-            p.setBrush(Qt::black);
-            p.setRenderHint(QPainter::Antialiasing);
-            if (m_cornersType == SquircledCorners) {
-                QPainterPath const squircle1 = superellipse((size - m_shadowOffset), m_squircleRatio, m_shadowOffset);
-                p.drawPolygon(squircle1.toFillPolygon());
-            } else {
-                p.drawEllipse(r.adjusted(m_shadowOffset, m_shadowOffset, -m_shadowOffset, -m_shadowOffset));
-            }
-        } else {
-            p.setPen(Qt::NoPen);
-            p.setRenderHint(QPainter::Antialiasing);
-            r.adjust(offset_decremented, offset_decremented, -offset_decremented, -offset_decremented);
-            if (outer_rect) {
-                p.setBrush(QColor(0, 0, 0, 255));
-            } else {
-                p.setBrush(QColor(255, 255, 255, 255));
-            }
-            if (m_cornersType == SquircledCorners) {
-                QPainterPath const squircle2 = superellipse((size - offset_decremented), m_squircleRatio, offset_decremented);
-                p.drawPolygon(squircle2.toFillPolygon());
-            } else {
-                p.drawEllipse(r);
-            }
-            p.setCompositionMode(QPainter::CompositionMode_DestinationOut);
-            p.setBrush(Qt::black);
-            r.adjust(1, 1, -1, -1);
-            if (m_cornersType == SquircledCorners) {
-                QPainterPath const squircle3 = superellipse((size - (offset_decremented + 1)), m_squircleRatio, (offset_decremented + 1));
-                p.drawPolygon(squircle3.toFillPolygon());
-            } else {
-                p.drawEllipse(r);
-            }
+            return false;
         }
-        p.end();
 
-        return img;
+        shape->frame = geo;
+        shape->radius = m_size;
+        shape->squircleRatio = cornerExponent();
+        return true;
     }
 
     bool LSHelper::hasShadow(KWin::EffectWindow const* w)
@@ -1,16 +1,8 @@
+#include "bandregion.h"
 #include "liblshelper_export.h"
 
-#include <QImage>
-#include <QPainterPath>
-#include <QRegion>
 #include <effect/effecthandler.h>
 
-template<typename T>
-int signum(T val)
-{
-    return (T(0) < val) - (val < T(0));
-}
-
 namespace Lightly {
     class LIBLSHELPER_EXPORT LSHelper : public QObject {
         Q_OBJECT
@@ -22,15 +14,22 @@ namespace Lightly {
 
         void reconfigure();
 
-        QPainterPath superellipse(float size, int n, int translate);
-        QImage genMaskImg(int size, bool mask, bool outer_rect);
+        /// The rounded frame of a window, the corners are clipped when the blur is drawn
+        struct CornerShape {
+            QRectF frame;
+            int radius = 0;
+            int squircleRatio = 0; // zero for circular corners
+        };
 
-        void roundBlurRegion(KWin::EffectWindow* w, QRegion* region);
+        bool cornerShape(KWin::EffectWindow* w, CornerShape* shape);
         bool isManagedWindow(KWin::EffectWindow const* w);
         void blurWindowAdded(KWin::EffectWindow* w);
         void blurWindowDeleted(KWin::EffectWindow* w);
 
+        /// The corner radius and the superellipse exponent of squircled corners, zero for circular ones.
+        /// The window shader and the blur both take their corners from here, so that they line up.
         int roundness() const;
+        int cornerExponent() const;
 
         enum {
             RoundedCorners = 0,
@@ -45,16 +44,10 @@ namespace Lightly {
             NTex
         };
 
-        QRegion* maskedRegions[NTex];
-
     private:
         bool hasShadow(KWin::EffectWindow const* w);
 
-        void setMaskRegions();
-
-        QRegion* createMaskRegion(QImage img, int size, int corner);
-
-        int m_size {}, m_cornersType {}, m_squircleRatio {}, m_shadowOffset {};
+        int m_size {}, m_cornersType {}, m_squircleRatio {};
         bool m_disabledForMaximized {};
         QList<KWin::EffectWindow*> m_managed {};
     };
@@ -96,22 +96,20 @@ namespace Lightly {
     void LightlyShadersEffect::windowAdded(KWin::EffectWindow* window)
     {
         m_windows[window].isManaged = false;
+        m_windows[window].isRedirected = false;
 
         if (!m_helper->isManagedWindow(window))
             return;
 
+        // Later changes come with the maximized state, only a new window has to be told by its geometry
         m_windows[window].isManaged = true;
-        m_windows[window].skipEffect = false;
+        m_windows[window].isMaximized = fillsMaximizeArea(window);
+        m_windows[window].skipEffect = skipsEffect(m_windows[window]);
 
         connect(window, &KWin::EffectWindow::windowMaximizedStateChanged, this, &LightlyShadersEffect::windowMaximizedStateChanged);
         connect(window, &KWin::EffectWindow::windowFullScreenChanged, this, &LightlyShadersEffect::windowFullScreenChanged);
 
-        QRectF maximized_area = KWin::effects->clientArea(KWin::MaximizeArea, window);
-        if (maximized_area == window->frameGeometry() && m_disabledForMaximized)
-            m_windows[window].skipEffect = true;
-
-        redirect(window);
-        setShader(window, m_shader.get());
+        updateRedirection(window);
     }
 
     void LightlyShadersEffect::windowFullScreenChanged(KWin::EffectWindow* window)
@@ -121,18 +119,47 @@ namespace Lightly {
         } else {
             m_windows[window].isManaged = true;
         }
+
+        updateRedirection(window);
     }
 
     void LightlyShadersEffect::windowMaximizedStateChanged(KWin::EffectWindow* window, bool horizontal, bool vertical)
     {
-        if (!m_disabledForMaximized)
+        m_windows[window].isMaximized = horizontal && vertical;
+        m_windows[window].skipEffect = skipsEffect(m_windows[window]);
+
+        updateRedirection(window);
+    }
+
+    bool LightlyShadersEffect::skipsEffect(LSWindowStruct const& window) const
+    {
+        return m_disabledForMaximized && window.isMaximized;
+    }
+
+    bool LightlyShadersEffect::fillsMaximizeArea(KWin::EffectWindow const* w) const
+    {
+        // Compare in whole pixels, fractional scaling leaves rounding noise in the frame geometry
+        QRect const maximized_area = KWin::effects->clientArea(KWin::MaximizeArea, w).toRect();
+        return maximized_area == w->frameGeometry().toRect();
+    }
+
+    void LightlyShadersEffect::updateRedirection(KWin::EffectWindow* w)
+    {
+        // Windows that don't get rounded corners are not redirected at all, so that
+        // they are painted directly and fullscreen ones can be scanned out.
+        LSWindowStruct& window = m_windows[w];
+        bool const needsEffect = window.isManaged && !window.skipEffect;
+
+        if (!m_shader || needsEffect == window.isRedirected)
             return;
 
-        if ((horizontal == true) && (vertical == true)) {
-            m_windows[window].skipEffect = true;
+        if (needsEffect) {
+            redirect(w);
+            setShader(w, m_shader.get());
         } else {
-            m_windows[window].skipEffect = false;
+            unredirect(w);
         }
+        window.isRedirected = needsEffect;
     }
 
     void LightlyShadersEffect::setRoundness(int const r, KWin::Output* s)
@@ -140,6 +167,7 @@ namespace Lightly {
         m_size = r;
         m_screens[s].sizeScaled = static_cast<float>(r) * m_screens[s].scale;
         m_corner = QSize(m_size + (m_shadowOffset - 1), m_size + (m_shadowOffset - 1));
+        ++m_cornerGeneration;
     }
 
     void LightlyShadersEffect::reconfigure(ReconfigureFlags flags)
@@ -156,8 +184,6 @@ namespace Lightly {
         m_outerOutlineColor = LightlyShadersConfig::outerOutlineColor();
         m_disabledForMaximized = LightlyShadersConfig::disabledForMaximized();
         m_shadowOffset = LightlyShadersConfig::shadowOffset();
-        m_squircleRatio = LightlyShadersConfig::squircleRatio();
-        m_cornersType = LightlyShadersConfig::cornersType();
 
         m_helper->reconfigure();
         m_roundness = m_helper->roundness();
@@ -173,6 +199,14 @@ namespace Lightly {
             m_outerOutlineWidth = 0.0;
         }
 
+        for (auto it = m_windows.begin(); it != m_windows.end(); ++it) {
+            if (!it->isManaged)
+                continue;
+
+            it->skipEffect = skipsEffect(*it);
+            updateRedirection(it.key());
+        }
+
         auto const screens = KWin::effects->screens();
         for (KWin::Output* s : screens) {
             if (KWin::effects->waylandDisplay() == nullptr) {
@@ -225,8 +259,22 @@ namespace Lightly {
         }
 
         QRectF const geo(w->frameGeometry());
+        LSWindowStruct& window = m_windows[w];
+        if (window.opaqueGeneration == m_cornerGeneration && window.opaqueGeometry == geo
+            && window.opaqueSource == data.opaque) {
+            // Nothing moved since the last frame, hand out the shared copy of the last result
+            data.opaque = window.opaqueTrimmed;
+            KWin::effects->prePaintWindow(w, data, time);
+            return;
+        }
+
+        // The squares holding the rounded corners and the shadow offset around them
+        int const cornerSize = m_size + m_shadowOffset;
+        BandRegion* opaque = &m_opaqueRegions[0];
+        BandRegion* trimmed = &m_opaqueRegions[1];
+        opaque->assign(data.opaque);
         for (int corner = 0; corner < LSHelper::NTex; ++corner) {
-            QRegion reg = QRegion(scale(m_helper->maskedRegions[corner]->boundingRect(), m_screens[s].scale).toRect());
+            QRect reg = scale(QRectF(0, 0, cornerSize, cornerSize), m_screens[s].scale).toRect();
             switch (corner) {
             case LSHelper::TopLeft:
                 reg.translate(geo.x() - m_shadowOffset, geo.y() - m_shadowOffset);
@@ -244,8 +292,15 @@ namespace Lightly {
                 break;
             }
 
-            data.opaque -= reg;
+            m_cornerRegion.assign(reg);
+            BandRegion::subtracted(*opaque, m_cornerRegion, *trimmed);
+            std::swap(opaque, trimmed);
         }
+        window.opaqueSource = data.opaque;
+        window.opaqueGeometry = geo;
+        window.opaqueGeneration = m_cornerGeneration;
+        window.opaqueTrimmed = opaque->toRegion();
+        data.opaque = window.opaqueTrimmed;
 
         KWin::effects->prePaintWindow(w, data, time);
     }
@@ -310,8 +365,8 @@ namespace Lightly {
         m_shader->setUniform(outerOutlineWidthLocation, static_cast<float>(m_outerOutlineWidth * m_screens[s].scale));
         m_shader->setUniform(drawInnerOutlineLocation, m_innerOutline);
         m_shader->setUniform(drawOuterOutlineLocation, m_outerOutline);
-        m_shader->setUniform(squircleRatioLocation, m_squircleRatio);
-        m_shader->setUniform(isSquircleLocation, (m_cornersType == LSHelper::SquircledCorners));
+        m_shader->setUniform(squircleRatioLocation, m_helper->cornerExponent());
+        m_shader->setUniform(isSquircleLocation, m_helper->cornerExponent() > 0);
 
         glActiveTexture(GL_TEXTURE0);
 
@@ -320,6 +375,17 @@ namespace Lightly {
         sm->popShader();
     }
 
+    bool LightlyShadersEffect::blocksDirectScanout() const
+    {
+        // Fullscreen windows are unredirected, so scanning one out loses nothing of ours.
+        // Should one still be redirected, its corners have to be drawn.
+        for (auto it = m_windows.cbegin(); it != m_windows.cend(); ++it) {
+            if (it->isRedirected && it.key()->isFullScreen())
+                return true;
+        }
+        return false;
+    }
+
     bool LightlyShadersEffect::enabledByDefault()
     {
         return supported();
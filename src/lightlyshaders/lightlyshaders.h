@@ -47,6 +47,7 @@ namespace Lightly {
         void drawWindow(KWin::RenderTarget const& renderTarget, KWin::RenderViewport const& viewport, KWin::EffectWindow* w, int mask, QRegion const& region, KWin::WindowPaintData& data) override;
 
         virtual int requestedEffectChainPosition() const override { return 99; }
+        bool blocksDirectScanout() const override;
 
     protected Q_SLOTS:
         void windowAdded(KWin::EffectWindow* window);
@@ -64,6 +65,14 @@ namespace Lightly {
         struct LSWindowStruct {
             bool skipEffect;
             bool isManaged;
+            bool isRedirected;
+            bool isMaximized = false;
+            // The opaque region KWin handed in and what was left of it after trimming the corners.
+            // Reused while the window, its opaque region and the corners stay the same.
+            QRegion opaqueSource;
+            QRegion opaqueTrimmed;
+            QRectF opaqueGeometry;
+            int opaqueGeneration = -1;
         };
 
         struct LSScreenStruct {
@@ -73,16 +82,23 @@ namespace Lightly {
         };
 
         bool isValidWindow(KWin::EffectWindow* w);
+        bool fillsMaximizeArea(KWin::EffectWindow const* w) const;
+        bool skipsEffect(LSWindowStruct const& window) const;
+        void updateRedirection(KWin::EffectWindow* w);
 
         LSHelper* m_helper {};
 
+        // Scratch space for trimming the corners off the opaque region without allocating
+        BandRegion m_opaqueRegions[2];
+        BandRegion m_cornerRegion;
+        // Bumped whenever the corner sizes change, which invalidates the trimmed regions of all windows
+        int m_cornerGeneration {};
+
         int m_size {};
         int m_innerOutlineWidth {};
         int m_outerOutlineWidth {};
         int m_roundness {};
         int m_shadowOffset {};
-        int m_squircleRatio {};
-        int m_cornersType {};
         bool m_innerOutline {}, m_outerOutline {}, m_darkTheme {}, m_disabledForMaximized {};
         QColor m_innerOutlineColor {}, m_outerOutlineColor {};
         std::unique_ptr<KWin::GLShader> m_shader {};